@@ -0,0 +1,57 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+SET DateStyle = ISO;
+
+CREATE TABLE builtin_enc (id integer primary key, u uuid, d date, t timestamp, tz timestamptz);
+CREATE TEMP TABLE builtin_enc_utc (id integer, tz json);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+SET timezone = 'America/Sao_Paulo';
+INSERT INTO builtin_enc VALUES
+(1, 'a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11', '2024-02-29', '2024-01-02 03:04:05.123456', '2024-01-02 03:04:05.12+00'),
+(2, '00000000-0000-0000-0000-000000000000', '0001-01-01', '2000-01-01 00:00:00', '1890-01-01 00:00:00+00'),
+(3, 'FFFFFFFF-FFFF-FFFF-FFFF-FFFFFFFFFFFF', '1999-12-31', '1900-06-30 23:59:59.5', '2018-11-04 00:30:00-03'),
+(4, '{12345678-1234-5678-1234-567812345678}', '0044-03-15 BC', '0044-03-15 12:00:00 BC', '0044-03-15 12:00:00+00 BC'),
+(5, NULL, 'infinity', 'infinity', '-infinity'),
+(6, NULL, '10000-01-01', '294276-12-31 23:59:59.999999', '1970-01-01 00:00:00.000001+00'),
+(7, NULL, NULL, NULL, NULL);
+
+-- the encoders write the same text as the output functions
+SELECT count(*) AS rows,
+       bool_and((c->1->'value')::text = coalesce(to_json(e.u::text)::text, 'null')) AS uuid,
+       bool_and((c->2->'value')::text = coalesce(to_json(e.d::text)::text, 'null')) AS date,
+       bool_and((c->3->'value')::text = coalesce(to_json(e.t::text)::text, 'null')) AS timestamp,
+       bool_and((c->4->'value')::text = coalesce(to_json(e.tz::text)::text, 'null')) AS timestamptz
+FROM (SELECT data::json->'columns' AS c FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0')) AS o
+JOIN builtin_enc e ON (c->0->>'value')::integer = e.id;
+
+-- offsets with minutes
+SET timezone = 'Asia/Kathmandu';
+SELECT count(*) AS rows,
+       bool_and((c->4->'value')::text = coalesce(to_json(e.tz::text)::text, 'null')) AS timestamptz
+FROM (SELECT data::json->'columns' AS c FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0')) AS o
+JOIN builtin_enc e ON (c->0->>'value')::integer = e.id;
+
+-- other DateStyle uses the output functions
+SET DateStyle = 'Postgres, MDY';
+SELECT count(*) AS rows,
+       bool_and((c->2->'value')::text = coalesce(to_json(e.d::text)::text, 'null')) AS date,
+       bool_and((c->3->'value')::text = coalesce(to_json(e.t::text)::text, 'null')) AS timestamp,
+       bool_and((c->4->'value')::text = coalesce(to_json(e.tz::text)::text, 'null')) AS timestamptz
+FROM (SELECT data::json->'columns' AS c FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0')) AS o
+JOIN builtin_enc e ON (c->0->>'value')::integer = e.id;
+
+-- utc-timestamptz ignores DateStyle and TimeZone
+INSERT INTO builtin_enc_utc
+SELECT (c->0->>'value')::integer, c->4->'value' FROM (SELECT data::json->'columns' AS c FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'utc-timestamptz', '1')) AS o;
+SET DateStyle = ISO;
+SET timezone = 'UTC';
+SELECT count(*) AS rows,
+       bool_and(x.tz::text = coalesce(to_json(e.tz::text)::text, 'null')) AS timestamptz
+FROM builtin_enc_utc x JOIN builtin_enc e USING (id);
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+DROP TABLE builtin_enc;
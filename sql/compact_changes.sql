@@ -0,0 +1,56 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE compact_changes (a integer primary key, b text);
+CREATE TABLE compact_changes_nopk (a integer);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+BEGIN;
+INSERT INTO compact_changes (a, b) VALUES(1, 'a'), (2, 'b'), (3, 'c');
+UPDATE compact_changes SET b = 'a2' WHERE a = 1;
+UPDATE compact_changes SET b = 'a3' WHERE a = 1;
+DELETE FROM compact_changes WHERE a = 2;
+COMMIT;
+
+BEGIN;
+UPDATE compact_changes SET b = 'c2' WHERE a = 3;
+UPDATE compact_changes SET b = 'c3' WHERE a = 3;
+DELETE FROM compact_changes WHERE a = 1;
+INSERT INTO compact_changes (a, b) VALUES(1, 'x');
+-- changes that cannot be merged are output after the buffered ones
+INSERT INTO compact_changes_nopk (a) VALUES(1);
+UPDATE compact_changes SET a = 4 WHERE a = 3;
+COMMIT;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'compact-changes', '1');
+-- spill every tuple to a temporary file
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'compact-changes', '1', 'compact-memory-limit', '0');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '1', 'compact-changes', '1');
+
+-- unchanged TOAST columns of an UPDATE are taken from the buffered tuple
+CREATE TABLE compact_changes_toast (a integer primary key, t text, c integer);
+ALTER TABLE compact_changes_toast ALTER COLUMN t SET STORAGE EXTERNAL;
+
+BEGIN;
+INSERT INTO compact_changes_toast (a, t, c) VALUES(1, repeat('x', 3000), 1);
+UPDATE compact_changes_toast SET c = 2 WHERE a = 1;
+COMMIT;
+
+BEGIN;
+UPDATE compact_changes_toast SET t = repeat('y', 4000) WHERE a = 1;
+UPDATE compact_changes_toast SET c = 3 WHERE a = 1;
+COMMIT;
+
+BEGIN;
+UPDATE compact_changes_toast SET c = 4 WHERE a = 1;
+UPDATE compact_changes_toast SET c = 5 WHERE a = 1;
+COMMIT;
+
+SELECT data::json->>'action' AS action, (SELECT string_agg((x->>'name') || '=' || CASE WHEN length(x->>'value') > 10 THEN 'length ' || length(x->>'value') ELSE x->>'value' END, ',') FROM json_array_elements(data::json->'columns') AS x) AS columns FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'add-tables', 'public.compact_changes_toast', 'compact-changes', '1');
+SELECT data::json->>'action' AS action, (SELECT string_agg((x->>'name') || '=' || CASE WHEN length(x->>'value') > 10 THEN 'length ' || length(x->>'value') ELSE x->>'value' END, ',') FROM json_array_elements(data::json->'columns') AS x) AS columns FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'add-tables', 'public.compact_changes_toast', 'compact-changes', '1', 'compact-memory-limit', '0');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+DROP TABLE compact_changes, compact_changes_nopk, compact_changes_toast;
@@ -0,0 +1,30 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE embed_json (id integer primary key, j json, jb jsonb);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO embed_json VALUES
+(1, '{"a": 1, "b": [true, null]}', '{"b": [1, 2.50, {"c": null}], "a": "x\"y"}'),
+(2, '[1, "two"]', '[]'),
+(3, '"str"', '"s\ttr"'),
+(4, '42', '-1.5e3'),
+(5, 'null', 'null'),
+(6, E'{ "k l" : [ 1 ,\n\t2 ] }', '{"k": {}, "l": [[], [false]]}'),
+(7, NULL, NULL);
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'include-types', '0', 'embed-json', '1');
+
+-- same values as the default output
+SELECT count(*) AS rows,
+       bool_and(coalesce((a.c->1->>'value')::jsonb, 'null') = (b.c->1->'value')::jsonb) AS json,
+       bool_and(coalesce((a.c->2->>'value')::jsonb, 'null') = (b.c->2->'value')::jsonb) AS jsonb
+FROM (SELECT data::json->'columns' AS c FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0')) AS a
+JOIN (SELECT data::json->'columns' AS c FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'embed-json', '1')) AS b
+ON (a.c->0->>'value') = (b.c->0->>'value');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+DROP TABLE embed_json;
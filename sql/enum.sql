@@ -0,0 +1,21 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TYPE enum_mood AS ENUM ('sad', 'ok', 'hap"py');
+CREATE TABLE enum_tbl (id integer primary key, m enum_mood);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO enum_tbl VALUES (1, 'sad'), (2, 'hap"py'), (3, NULL);
+UPDATE enum_tbl SET m = 'ok' WHERE id = 1;
+-- labels are invalidated
+ALTER TYPE enum_mood RENAME VALUE 'ok' TO 'fine';
+INSERT INTO enum_tbl VALUES (4, 'fine');
+
+SELECT data FROM pg_logical_slot_get_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+DROP TABLE enum_tbl;
+DROP TYPE enum_mood;
@@ -0,0 +1,30 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE epoch_tbl (id integer primary key, a timestamp, b timestamptz, c date, d time);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO epoch_tbl VALUES (1, '2024-01-02 03:04:05.123456', '2024-01-02 03:04:05.123456+00', '2024-01-02', '03:04:05.5');
+INSERT INTO epoch_tbl VALUES (2, '1969-12-31 23:59:59', '1999-12-31 23:00:00-01', '1970-01-01', '00:00:00');
+INSERT INTO epoch_tbl VALUES (3, 'infinity', '-infinity', 'infinity', NULL);
+
+-- temporal columns
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'epoch-temporal', '1');
+
+-- commit timestamps and LSNs are integers
+SELECT DISTINCT json_typeof(data::json->'timestamp') AS timestamp, json_typeof(data::json->'lsn') AS lsn, json_typeof(data::json->'nextlsn') AS nextlsn FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-timestamp', '1', 'include-lsn', '1', 'epoch-timestamp', '1', 'numeric-lsn', '1') ORDER BY 1, 2, 3;
+SELECT DISTINCT json_typeof(data::json->'timestamp') AS timestamp, json_typeof(data::json->'nextlsn') AS nextlsn FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '1', 'include-timestamp', '1', 'include-lsn', '1', 'epoch-timestamp', '1', 'numeric-lsn', '1');
+
+-- and they are the same values
+WITH a AS (SELECT row_number() OVER () AS n, data::json AS j FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-timestamp', '1', 'include-lsn', '1')),
+b AS (SELECT row_number() OVER () AS n, data::json AS j FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-timestamp', '1', 'include-lsn', '1', 'epoch-timestamp', '1', 'numeric-lsn', '1'))
+SELECT count(*) AS objects,
+       bool_and('epoch'::timestamptz + (b.j->>'timestamp')::bigint * interval '1 microsecond' = (a.j->>'timestamp')::timestamptz) AS timestamp,
+       bool_and((a.j->>'lsn')::pg_lsn - '0/0' = (b.j->>'lsn')::numeric) AS lsn
+FROM a JOIN b USING (n);
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+DROP TABLE epoch_tbl;
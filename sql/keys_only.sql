@@ -0,0 +1,24 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE keys_only (a integer, b integer, c text, PRIMARY KEY(a, b));
+CREATE TABLE keys_only_nopk (a integer);
+CREATE TABLE keys_only_full (a integer, b text);
+ALTER TABLE keys_only_full REPLICA IDENTITY FULL;
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO keys_only (a, b, c) VALUES(1, 2, 'foo');
+UPDATE keys_only SET c = 'bar' WHERE a = 1;
+UPDATE keys_only SET b = 3 WHERE a = 1;
+DELETE FROM keys_only WHERE a = 1;
+INSERT INTO keys_only_nopk (a) VALUES(1);
+INSERT INTO keys_only_full (a, b) VALUES(1, 'foo');
+DELETE FROM keys_only_full WHERE a = 1;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'keys-only', '1');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '1', 'keys-only', '1');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
@@ -0,0 +1,20 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+SELECT 'msg1' FROM pg_logical_emit_message(false, 'app.orders', 'm1');
+SELECT 'msg2' FROM pg_logical_emit_message(false, 'app.users', 'm2');
+SELECT 'msg3' FROM pg_logical_emit_message(false, 'application', 'm3');
+SELECT 'msg4' FROM pg_logical_emit_message(false, 'audit', 'm4');
+SELECT 'msg5' FROM pg_logical_emit_message(false, 'app*', 'm5');
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'add-msg-prefixes', 'app.*');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'add-msg-prefixes', 'app*');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'add-msg-prefixes', 'app\*');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'filter-msg-prefixes', 'app.*, audit');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'filter-msg-prefixes', 'app.users', 'add-msg-prefixes', 'app.*, audit');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
@@ -0,0 +1,23 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE partition_root (a integer, b text, PRIMARY KEY(a)) PARTITION BY RANGE (a);
+CREATE TABLE partition_root_1 PARTITION OF partition_root FOR VALUES FROM (0) TO (10);
+-- column order differs from the partition root
+CREATE TABLE partition_root_2 (b text, a integer NOT NULL);
+ALTER TABLE partition_root ATTACH PARTITION partition_root_2 FOR VALUES FROM (10) TO (20);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO partition_root (a, b) VALUES(1, 'x'), (11, 'y');
+UPDATE partition_root SET b = 'z' WHERE a = 11;
+DELETE FROM partition_root WHERE a = 1;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'publish-via-partition-root', '1');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'publish-via-partition-root', '1', 'filter-tables', 'public.partition_root');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '1', 'publish-via-partition-root', '1');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
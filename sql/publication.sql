@@ -0,0 +1,31 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE publication_a (a integer primary key);
+CREATE TABLE publication_b (a integer primary key);
+CREATE TABLE publication_c (a integer primary key);
+CREATE PUBLICATION wal2json_pub_a FOR TABLE publication_a;
+CREATE PUBLICATION wal2json_pub_b FOR TABLE publication_b WITH (publish = 'insert');
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO publication_a (a) VALUES(1);
+INSERT INTO publication_b (a) VALUES(1);
+INSERT INTO publication_c (a) VALUES(1);
+DELETE FROM publication_a WHERE a = 1;
+DELETE FROM publication_b WHERE a = 1;
+-- publication changes are seen by the following changes
+ALTER PUBLICATION wal2json_pub_a ADD TABLE publication_c;
+INSERT INTO publication_c (a) VALUES(2);
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'publication-names', 'wal2json_pub_a');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'publication-names', 'wal2json_pub_a, wal2json_pub_b');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'publication-names', 'wal2json_pub_b', 'actions', 'delete');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'publication-names', 'wal2json_pub_a, wal2json_pub_b', 'filter-tables', 'public.publication_a');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'publication-names', 'wal2json_pub_foo');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+
+DROP PUBLICATION wal2json_pub_a, wal2json_pub_b;
@@ -0,0 +1,76 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE shard_a (id integer primary key, b text);
+CREATE TABLE shard_b (id integer primary key, b text);
+CREATE TABLE shard_c (c text);
+CREATE TEMP TABLE shard_out (shard integer, data text);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO shard_a (id, b) SELECT i, 'a' || i FROM generate_series(1, 20) i;
+INSERT INTO shard_b (id, b) SELECT i, 'b' || i FROM generate_series(1, 20) i;
+UPDATE shard_a SET b = b || 'x' WHERE id % 3 = 0;
+DELETE FROM shard_a WHERE id % 4 = 0;
+INSERT INTO shard_c (c) VALUES('c1'), ('c2');
+
+-- shard by key
+INSERT INTO shard_out
+SELECT 0, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '2', 'shard-id', '0')
+UNION ALL
+SELECT 1, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '2', 'shard-id', '1')
+UNION ALL
+SELECT -1, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2');
+
+-- each change is in exactly one shard
+SELECT (SELECT count(*) FROM shard_out WHERE shard >= 0 AND data::json->>'action' IN ('I', 'U', 'D')) = (SELECT count(*) FROM shard_out WHERE shard = -1 AND data::json->>'action' IN ('I', 'U', 'D')) AS all_changes;
+SELECT count(*) FROM (SELECT data FROM shard_out WHERE shard = 0 AND data::json->>'action' IN ('I', 'U', 'D') INTERSECT SELECT data FROM shard_out WHERE shard = 1) AS s;
+-- changes of the same row are in the same shard
+SELECT count(*) FROM (SELECT data::json->>'table', coalesce(data::json->'identity'->0->>'value', data::json->'columns'->0->>'value') FROM shard_out WHERE shard >= 0 AND data::json->>'table' <> 'shard_c' AND data::json->>'action' IN ('I', 'U', 'D') GROUP BY 1, 2 HAVING count(DISTINCT shard) > 1) AS s;
+-- both shards have changes
+SELECT shard, count(*) > 0 AS has_changes FROM shard_out WHERE shard >= 0 AND data::json->>'action' IN ('I', 'U', 'D') GROUP BY shard ORDER BY shard;
+-- transactions are in all shards
+SELECT shard, count(*) FILTER (WHERE data::json->>'action' = 'B') = (SELECT count(*) FROM shard_out WHERE shard = -1 AND data::json->>'action' = 'B') AS all_transactions FROM shard_out WHERE shard >= 0 GROUP BY shard ORDER BY shard;
+
+-- shard by table
+TRUNCATE shard_out;
+INSERT INTO shard_out
+SELECT 0, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '2', 'shard-id', '0', 'shard-by', 'table')
+UNION ALL
+SELECT 1, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '2', 'shard-id', '1', 'shard-by', 'table')
+UNION ALL
+SELECT -1, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2');
+
+SELECT data::json->>'table' AS tbl, count(DISTINCT shard) AS shards, count(*) AS changes FROM shard_out WHERE shard >= 0 AND data::json->>'action' IN ('I', 'U', 'D') GROUP BY 1 ORDER BY 1;
+
+-- format version 1
+SELECT (SELECT sum(json_array_length(data::json->'change')) FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'shard-count', '2', 'shard-id', '0')) + (SELECT sum(json_array_length(data::json->'change')) FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'shard-count', '2', 'shard-id', '1')) = (SELECT sum(json_array_length(data::json->'change')) FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL)) AS all_changes;
+
+-- an UPDATE that changes the key is a DELETE in the old shard and an INSERT in the new shard
+CREATE TABLE shard_k (id integer primary key, b text);
+INSERT INTO shard_k (id, b) SELECT i, 'k' || i FROM generate_series(1, 20) i;
+UPDATE shard_k SET id = id + 100;
+DELETE FROM shard_k;
+
+TRUNCATE shard_out;
+INSERT INTO shard_out
+SELECT 0, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '2', 'shard-id', '0', 'add-tables', 'public.shard_k')
+UNION ALL
+SELECT 1, data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '2', 'shard-id', '1', 'add-tables', 'public.shard_k');
+
+SELECT count(*) FILTER (WHERE a = 'I') = count(*) FILTER (WHERE a = 'D') AS balanced, count(*) FILTER (WHERE a = 'U') < 20 AS moved FROM (SELECT data::json->>'action' AS a FROM shard_out) AS s;
+-- each key is in one shard
+SELECT count(*) FROM (SELECT k FROM (SELECT shard, data::json->'columns'->0->>'value' AS k FROM shard_out WHERE data::json->>'action' IN ('I', 'U') UNION ALL SELECT shard, data::json->'identity'->0->>'value' FROM shard_out WHERE data::json->>'action' IN ('U', 'D')) AS e GROUP BY k HAVING count(DISTINCT shard) > 1) AS s;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '2', 'shard-id', '2');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-count', '0');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'shard-by', 'foo');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+
+DROP TABLE shard_a;
+DROP TABLE shard_b;
+DROP TABLE shard_c;
+DROP TABLE shard_k;
@@ -0,0 +1,22 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+SET DateStyle = 'ISO, YMD';
+
+CREATE TYPE structured_point AS (label text, tags integer[], d date);
+CREATE TABLE structured_types (id integer primary key, a integer[], b text[], c structured_point, r int4range, n numeric[]);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO structured_types VALUES
+(1, '{1,NULL,3}', '{{a,"b c"},{"d\"",e}}', ROW('p1', '{4,5}', '2020-01-02'), '[1,10)', '{1.5,NaN}'),
+(2, '{}', NULL, ROW(NULL, NULL, NULL), '(,5]', NULL),
+(3, '[0:1]={7,8}', '{}', NULL, 'empty', '{}');
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'include-types', '0', 'structured-types', '1');
+-- default is unchanged
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'include-types', '0');
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+DROP TABLE structured_types;
+DROP TYPE structured_point;
@@ -0,0 +1,35 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE summary_a (a integer primary key);
+CREATE SCHEMA summary_schema;
+CREATE TABLE summary_schema.summary_b (a integer primary key);
+CREATE TABLE summary_schema.summary_a (a integer primary key);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+BEGIN;
+INSERT INTO summary_a (a) SELECT generate_series(1, 5);
+UPDATE summary_a SET a = a + 10 WHERE a <= 2;
+DELETE FROM summary_a WHERE a = 5;
+INSERT INTO summary_schema.summary_b (a) VALUES(1);
+COMMIT;
+
+INSERT INTO summary_schema.summary_b (a) VALUES(2);
+DELETE FROM summary_schema.summary_b;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'summary', '1');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'summary', '1', 'include-schemas', '0', 'actions', 'insert, update', 'filter-tables', 'summary_schema.*');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '1', 'summary', '1');
+
+-- without schemas, counts of tables with the same name are merged
+BEGIN;
+INSERT INTO summary_a (a) VALUES(100);
+INSERT INTO summary_schema.summary_a (a) VALUES(1), (2);
+COMMIT;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'summary', '1', 'include-schemas', '0', 'add-tables', '*.summary_a');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
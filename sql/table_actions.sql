@@ -0,0 +1,26 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE SCHEMA table_actions_audit;
+CREATE TABLE table_actions_audit.log (a integer primary key);
+CREATE TABLE table_actions_orders (a integer primary key);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO table_actions_audit.log (a) VALUES(1);
+UPDATE table_actions_audit.log SET a = 2 WHERE a = 1;
+DELETE FROM table_actions_audit.log WHERE a = 2;
+INSERT INTO table_actions_orders (a) VALUES(1);
+UPDATE table_actions_orders SET a = 2 WHERE a = 1;
+DELETE FROM table_actions_orders WHERE a = 2;
+TRUNCATE TABLE table_actions_audit.log, table_actions_orders;
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'table-actions', 'table_actions_audit.*');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'table-actions', 'table_actions_audit.*:insert+foo');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'table-actions', 'table_actions_audit.*:insert,public.table_actions_orders:update+delete+truncate');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'actions', 'delete', 'table-actions', 'table_actions_audit.*:insert');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '1', 'table-actions', 'table_actions_audit.*:insert');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
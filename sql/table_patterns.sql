@@ -0,0 +1,34 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE TABLE events_2024_01 (a integer primary key);
+CREATE TABLE events_2024_02 (a integer primary key);
+CREATE TABLE events_2023_01 (a integer primary key);
+CREATE TABLE t_1 (a integer primary key);
+CREATE TABLE t_12 (a integer primary key);
+CREATE TABLE t_x (a integer primary key);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+BEGIN;
+INSERT INTO events_2024_01 (a) VALUES(1);
+INSERT INTO events_2024_02 (a) VALUES(1);
+INSERT INTO events_2023_01 (a) VALUES(1);
+INSERT INTO t_1 (a) VALUES(1);
+INSERT INTO t_12 (a) VALUES(1);
+INSERT INTO t_x (a) VALUES(1);
+COMMIT;
+
+-- glob
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'add-tables', 'public.events_2024_*');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'add-tables', 'public.events_202?_01');
+-- regular expression
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'add-tables-regex', '^public\.t_[0-9]+$');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'filter-tables-regex', 'events');
+-- both
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'add-tables', '*.events_2023_01', 'add-tables-regex', '\.t_[0-9]+$', 'filter-tables', 'public.t_1?');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'add-tables-regex', '(');
+
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
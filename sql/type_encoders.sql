@@ -0,0 +1,29 @@
+\set VERBOSITY terse
+
+-- predictability
+SET synchronous_commit = on;
+
+CREATE SCHEMA type_encoders_fn;
+CREATE FUNCTION type_encoders_fn.point_json(point) RETURNS json AS $$ SELECT json_build_object('x', $1[0], 'y', $1[1]) $$ LANGUAGE sql IMMUTABLE STRICT;
+CREATE FUNCTION inet_host_text(inet) RETURNS text AS $$ SELECT host($1) $$ LANGUAGE sql IMMUTABLE STRICT;
+CREATE FUNCTION macaddr_bytes(macaddr) RETURNS bytea AS $$ SELECT decode(replace($1::text, ':', ''), 'hex') $$ LANGUAGE sql IMMUTABLE STRICT;
+CREATE FUNCTION inet_family(inet) RETURNS integer AS $$ SELECT family($1) $$ LANGUAGE sql IMMUTABLE STRICT;
+CREATE FUNCTION inet_null(inet) RETURNS text AS $$ SELECT NULL::text $$ LANGUAGE sql IMMUTABLE;
+
+CREATE TABLE type_encoders (id integer primary key, p point, i inet, m macaddr);
+
+SELECT 'init' FROM pg_create_logical_replication_slot('regression_slot', 'wal2json');
+
+INSERT INTO type_encoders VALUES (1, '(1,2)', '192.168.0.1/24', '08:00:2b:01:02:03'), (2, NULL, NULL, NULL);
+
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'include-types', '0', 'type-encoders', 'point:type_encoders_fn.point_json,inet:public.inet_host_text,macaddr:public.macaddr_bytes');
+-- null result
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'include-transaction', '0', 'include-types', '0', 'type-encoders', 'inet:public.inet_null');
+-- invalid values
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'type-encoders', 'point');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'type-encoders', 'inet:public.inet_family');
+SELECT data FROM pg_logical_slot_peek_changes('regression_slot', NULL, NULL, 'format-version', '2', 'type-encoders', 'inet:inet_host_text');
+SELECT 'stop' FROM pg_drop_replication_slot('regression_slot');
+DROP TABLE type_encoders;
+DROP FUNCTION type_encoders_fn.point_json(point), inet_host_text(inet), macaddr_bytes(macaddr), inet_family(inet), inet_null(inet);
+DROP SCHEMA type_encoders_fn;
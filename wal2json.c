@@ -15,24 +15,63 @@
 #include "access/genam.h"
 #include "access/heapam.h"
 #include "access/sysattr.h"
+#if PG_VERSION_NUM >= 130000
+#include "access/detoast.h"
+#else
+#include "access/tuptoaster.h"
+#endif
+#include "access/tupconvert.h"
 #include "catalog/indexing.h"
+#if PG_VERSION_NUM >= 130000
+#include "common/hashfn.h"
+#else
+#include "access/hash.h"
+#endif
 #include "catalog/pg_attrdef.h"
+#include "catalog/pg_collation.h"
+#include "catalog/pg_enum.h"
+#if PG_VERSION_NUM >= 110000
+#include "catalog/partition.h"
+#endif
+#if PG_VERSION_NUM >= 100000
+#include "catalog/pg_publication.h"
+#endif
 #include "catalog/pg_type.h"
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "nodes/value.h"
+#include "parser/parse_func.h"
+#include "regex/regex.h"
 
 #include "replication/logical.h"
 #if PG_VERSION_NUM >= 90500
 #include "replication/origin.h"
 #endif
 
+#include "storage/buffile.h"
+
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/datum.h"
+#include "utils/datetime.h"
 #include "utils/fmgroids.h"
 #include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
 #include "utils/json.h"
+#include "utils/jsonb.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
-#include "utils/pg_lsn.h"
+#include "utils/rangetypes.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
+#include "utils/timestamp.h"
+#include "utils/typcache.h"
+#include "utils/uuid.h"
+#if PG_VERSION_NUM >= 100000
+#include "utils/varlena.h"
+#endif
 
 #define WAL2JSON_VERSION				"2.6"
 #define WAL2JSON_VERSION_NUM			206
@@ -60,9 +99,57 @@ typedef struct
 	bool	truncate;
 } JsonAction;
 
+/*
+ * Message prefixes compiled at startup. Exact prefixes are sorted for binary
+ * search. Prefixes that end with an unescaped '*' match any message prefix
+ * that starts with them.
+ */
+typedef struct
+{
+	int		nexact;
+	char	**exact;			/* sorted */
+	int		nwildcard;
+	char	**wildcard;			/* without the trailing '*' */
+	int		*wildcardlen;
+} JsonPrefixFilter;
+
+/*
+ * Changes of a transaction that are merged per (relation, replica identity)
+ * by compact-changes. Tuples that do not fit in compact-memory-limit are
+ * written to a temporary file.
+ */
+typedef struct JsonCompactState
+{
+	bool		active;				/* compacting the current transaction? */
+	MemoryContext context;			/* buffered changes; reset per transaction */
+	MemoryContext output_context;	/* reset per output change */
+	HTAB		*hash;				/* JsonCompactEntry */
+	struct JsonCompactPosition *positions;	/* output order */
+	int			npositions;
+	int			maxpositions;
+	int			seqno;
+	uint64		nchanges;			/* # of merged changes */
+	Size		bytes;				/* tuples in memory */
+	BufFile		*file;				/* spilled tuples or NULL */
+	int			endfileno;			/* end of file */
+	off_t		endoffset;
+} JsonCompactState;
+
+/* Per-transaction row counts of summary mode */
+typedef struct JsonSummaryState
+{
+	MemoryContext context;			/* reset per transaction */
+	HTAB		*hash;				/* JsonSummaryEntry */
+	List		*tables;			/* JsonSummaryEntry in output order */
+} JsonSummaryState;
+
 typedef struct
 {
-	MemoryContext context;
+	MemoryContext context;			/* reset per change */
+	MemoryContext txn_context;		/* reset per transaction */
+	ReorderBufferTXN *fragment_txn;	/* transaction of txn_fragment */
+	char		*txn_fragment;		/* ,"xid":...,"timestamp":...,"origin":... */
+	int			txn_fragment_len;
 	bool		include_transaction;	/* BEGIN and COMMIT objects (v2) */
 	bool		include_xids;		/* include transaction ids */
 	bool		include_timestamp;	/* include transaction timestamp */
@@ -80,14 +167,40 @@ typedef struct
 	bool		pretty_print;		/* pretty-print JSON? */
 	bool		write_in_chunks;	/* write in chunks? (v1) */
 	bool		numeric_data_types_as_string;	/* use strings for numeric data types */
+	bool		publish_via_partition_root;	/* output partition changes as root changes */
+	bool		keys_only;			/* output only replica identity columns (v2) */
+	bool		compact_changes;	/* merge changes per row (v2) */
+	int			compact_memory_limit;	/* in kB */
+	JsonCompactState *compact_state;
+	bool		summary;			/* output only row counts per transaction (v2) */
+	int			shard_count;		/* # of shards */
+	int			shard_id;			/* output only changes of this shard */
+	bool		shard_by_table;		/* use table instead of key */
+	JsonSummaryState *summary_state;
 
 	JsonAction	actions;			/* output only these actions */
 
 	List		*filter_origins;	/* filter out origins */
 	List		*filter_tables;		/* filter out tables */
 	List		*add_tables;		/* add only these tables */
+	List		*table_actions;		/* output only these actions per table */
+	regex_t		*filter_tables_regex;	/* filter out tables that match */
+	regex_t		*add_tables_regex;	/* add only tables that match */
 	List		*filter_msg_prefixes;	/* filter by message prefixes */
 	List		*add_msg_prefixes;	/* add only messages with these prefixes */
+	List		*publication_names;	/* add only tables from these publications */
+	List		*publications;		/* Publication for each name (publication_context) */
+	List		*type_encoders;		/* JsonTypeEncoder for each type:function */
+	bool		type_encoders_resolved;	/* type_encoders have OIDs */
+	int			max_value_size;		/* larger varlena values are elided (0 = off) */
+	List		*elide_types;		/* type names whose values are elided */
+	List		*elide_typids;		/* elide_types OIDs, looked up at first use */
+	bool		elide_types_resolved;
+
+	/* compiled filters (see above) */
+	Bitmapset	*filter_origins_set;
+	JsonPrefixFilter *filter_prefixes;
+	JsonPrefixFilter *add_prefixes;
 
 	int			format_version;		/* support different formats */
 
@@ -96,14 +209,27 @@ typedef struct
 	 * It is useful for tools that wants a position to restart from.
 	 */
 	bool		include_lsn;		/* include LSNs */
+	bool		numeric_lsn;		/* LSNs as integers */
+	bool		epoch_timestamp;	/* commit timestamp as Unix epoch microseconds */
+	bool		epoch_temporal;		/* temporal columns as Unix epoch integers */
+	bool		utc_timestamptz;	/* timestamptz columns in UTC */
+	bool		embed_json;			/* json and jsonb columns as JSON */
+	bool		structured_types;	/* arrays, composites, ranges, hstore as JSON */
 
 	uint64		nr_changes;			/* # of passes in pg_decode_change() */
 									/* FIXME replace with txn->nentries */
+	uint64		nr_reserved;		/* # of times the output was enlarged before a change */
+	uint64		nr_enlarged;		/* # of times the output was enlarged during a change */
+	int			reserved_maxlen;	/* output size after the reservation */
 
 	/* pretty print */
 	char		ht[2];				/* horizontal tab, if pretty print */
 	char		nl[2];				/* new line, if pretty print */
 	char		sp[2];				/* space, if pretty print */
+
+	MemoryContext cache_context;	/* per-relation state */
+	MemoryContext type_context;		/* JsonTypeCache */
+	MemoryContext publication_context;	/* publications */
 } JsonDecodingData;
 
 typedef enum
@@ -119,8 +245,206 @@ typedef struct SelectTable
 	char	*tablename;
 	bool	allschemas;				/* true means any schema */
 	bool	alltables;				/* true means any table */
+	char	*schemapattern;			/* glob pattern or NULL if exact name */
+	char	*tablepattern;			/* glob pattern or NULL if exact name */
+	JsonAction	actions;			/* actions for this table (table-actions) */
 } SelectTable;
 
+/* How a column value is written */
+typedef enum
+{
+	JSON_VALUE_STRING,
+	JSON_VALUE_NUMBER,
+	JSON_VALUE_BOOL,
+	JSON_VALUE_BYTEA,
+	/* written by pg_encode_builtin() if possible */
+	JSON_VALUE_TIMESTAMP,
+	JSON_VALUE_TIMESTAMPTZ,
+	JSON_VALUE_DATE,
+	JSON_VALUE_TIME,
+	JSON_VALUE_UUID,
+	JSON_VALUE_ENUM,
+	JSON_VALUE_JSON,
+	JSON_VALUE_JSONB,
+	JSON_VALUE_ARRAY,
+	JSON_VALUE_COMPOSITE,
+	JSON_VALUE_RANGE,
+	JSON_VALUE_HSTORE,
+	JSON_VALUE_CUSTOM			/* type-encoders */
+} JsonValueKind;
+
+/*
+ * Column plan. Dropped columns are not in it and the output function and
+ * key membership of each column are resolved when it is built instead of for
+ * every value. Everything that surrounds the value depends only on the column
+ * and the options hence it is built once too.
+ */
+typedef struct JsonColumn
+{
+	int			attidx;				/* index into the tuple descriptor */
+	bool		identity;			/* replica identity column? */
+	bool		pk;					/* primary key column? */
+	bool		rikey;				/* replica identity index column? */
+	bool		isvarlena;
+	JsonValueKind kind;
+	Oid			typid;				/* type that kind was chosen for */
+	uint32		typhash;			/* syscache hash of typid */
+	FmgrInfo	outfunc;
+	bool		elide;				/* type is in elide-types */
+	int16		typlen;				/* set if elide */
+	bool		typbyval;
+	char		*prefix;			/* {"name":...,"type":...,"typeoid":... */
+	int			prefixlen;
+	char		*suffix;			/* ,"optional":...,"position":...,"default":...} */
+	int			suffixlen;
+	char		*defval;			/* quoted default expression or null */
+	/* format 1 writes each attribute in its own array */
+	char		*name;
+	char		*type;
+	char		*typeoid;
+	char		*position;
+	bool		notnull;
+} JsonColumn;
+
+/*
+ * Tuple broken down into columns. A change writes the same tuple in several
+ * sections (columns, identity, pk) hence it is deformed once and each value is
+ * encoded once; an encoded value is copied from where it was first written in
+ * the output.
+ */
+typedef struct JsonTuple
+{
+	HeapTuple	tuple;
+	bool		deformed;			/* all columns are fetched? */
+	bool		*fetched;
+	Datum		*values;
+	bool		*nulls;
+	int			*encstart;			/* offset in the output or -1 */
+	int			*enclen;
+} JsonTuple;
+
+/*
+ * Per-relation state. Table filters are evaluated once per relation and the
+ * result is kept here until the relation (or its schema) is invalidated.
+ */
+typedef struct JsonRelationEntry
+{
+	Oid			relid;				/* hash key (must be first) */
+	bool		valid;				/* is this entry up to date? */
+	bool		selected;			/* passes filter-tables and add-tables? */
+	JsonAction	actions;			/* output only these actions */
+	Oid			publish_as_relid;	/* partition root or relid itself */
+	TupleConversionMap *map;		/* relid to publish_as_relid or NULL */
+	uint32		tablehash;			/* shard of changes without key */
+	int			nshardkeys;			/* 0 means shard by table */
+	AttrNumber	*shardkeys;			/* key columns */
+	FmgrInfo	*shardprocs;		/* hash functions of key columns */
+	Oid			*shardcolls;		/* collations of key columns */
+	char		*header[3];			/* format 1: change header per action */
+	int			headerlen[3];
+	char		*names;				/* format 2: ,"schema":...,"table":... */
+	int			nameslen;
+	int			avgsize;			/* moving average of encoded changes */
+	int			maxsize;			/* largest recent encoded change */
+	MemoryContext plan_context;		/* column plan, built on first use */
+	int			ncolumns;
+	int			nidentity;			/* # of replica identity columns */
+	int			npk;				/* # of primary key columns */
+	JsonColumn	*columns;
+} JsonRelationEntry;
+
+static HTAB *JsonRelationCache = NULL;
+
+/* Enum label as a JSON string, per enum value */
+typedef struct JsonEnumEntry
+{
+	Oid			enumoid;			/* hash key (must be first) */
+	char		*label;
+	int			len;
+} JsonEnumEntry;
+
+static HTAB *JsonEnumCache = NULL;
+
+/*
+ * Function that writes values of a type (type-encoders). It returns json,
+ * jsonb, text or bytea. Names are resolved when the first change is decoded
+ * and kept for the session.
+ */
+typedef struct JsonTypeEncoder
+{
+	char		*typname;
+	char		*funcname;
+	Oid			typid;
+	Oid			rettype;
+	FmgrInfo	flinfo;
+} JsonTypeEncoder;
+
+/*
+ * How values of a type are written when they are not columns (array
+ * elements, attributes of composites and range bounds) and how structured
+ * values are taken apart. It is emptied if pg_type changes.
+ */
+typedef struct JsonTypeEntry
+{
+	Oid			typid;				/* hash key (must be first) */
+	JsonValueKind kind;
+	bool		isvarlena;
+	FmgrInfo	outfunc;
+	int16		typlen;				/* storage, for arrays of this type */
+	bool		typbyval;
+	char		typalign;
+	JsonTypeEncoder *encoder;		/* type-encoders or hstore_to_json() */
+} JsonTypeEntry;
+
+static HTAB *JsonTypeCache = NULL;
+static bool JsonTypeCacheValid = false;
+
+typedef struct JsonSummaryEntry
+{
+	Oid			relid;				/* hash key (must be first) */
+	char		*name;				/* (qualified) table name */
+	uint64		count[4];			/* INSERT, UPDATE, DELETE, TRUNCATE */
+	struct JsonSummaryEntry *counts;	/* entry that is output for name */
+} JsonSummaryEntry;
+
+typedef struct JsonCompactKey
+{
+	Oid			relid;
+	uint32		len;
+	char		*data;				/* replica identity values */
+} JsonCompactKey;
+
+typedef struct JsonCompactTuple
+{
+	HeapTuple	tuple;				/* in memory or NULL */
+	bool		spilled;			/* in compaction file? */
+	int			fileno;
+	off_t		offset;
+	uint32		len;
+} JsonCompactTuple;
+
+typedef struct JsonCompactEntry
+{
+	JsonCompactKey	key;			/* hash key (must be first) */
+	char			action;			/* net change: I, U, D or 0 (none) */
+	int				seqno;			/* current output position */
+	XLogRecPtr		lsn;			/* last change */
+	JsonCompactTuple newtuple;
+	JsonCompactTuple oldtuple;
+} JsonCompactEntry;
+
+typedef struct JsonCompactPosition
+{
+	JsonCompactEntry *entry;
+	int			seqno;				/* stale if it doesn't match entry */
+} JsonCompactPosition;
+
+/* is data->publications up to date? */
+static bool JsonPublicationsValid = false;
+
+/* is there any entry whose publish_as_relid is not its relid? */
+static bool JsonRelationCacheHasRoots = false;
+
 /* These must be available to pg_dlsym() */
 static void pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is_init);
 static void pg_decode_shutdown(LogicalDecodingContext *ctx);
@@ -146,18 +470,73 @@ static void pg_decode_truncate(LogicalDecodingContext *ctx,
 					ReorderBufferChange *change);
 #endif
 
-static void columns_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, bool addcomma, Relation relation);
-static void tuple_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, Bitmapset *bs, bool replident, bool addcomma, Relation relation);
-static void pk_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, Bitmapset *bs, bool addcomma);
-static void identity_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, Bitmapset *bs);
+static void columns_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, JsonTuple *jt, bool addcomma, Relation relation);
+static void pg_v1_open_array(JsonDecodingData *data, StringInfo out, bool replident, const char *name);
+static void pg_v1_close_array(JsonDecodingData *data, StringInfo out, bool addcomma);
+static void pg_v1_separator(JsonDecodingData *data, StringInfo out, bool *first);
+static void tuple_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, JsonTuple *jt, bool keys, bool replident, bool addcomma, Relation relation);
+static void pk_to_stringinfo(LogicalDecodingContext *ctx, Relation relation, bool addcomma);
+static void identity_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, JsonTuple *jt, bool keys, Relation relation);
 static bool parse_table_identifier(List *qualified_tables, char separator, List **select_tables);
+static char *parse_table_pattern(char **rawp, char separator, bool *haswildcard);
 static bool string_to_SelectTable(char *rawstring, char separator, List **select_tables);
+static bool string_to_SelectTableAction(char *rawstring, char separator, List **select_tables);
+static bool string_to_JsonAction(char *rawstring, char separator, JsonAction *actions);
 static bool split_string_to_list(char *rawstring, char separator, List **sl);
 static bool split_string_to_oid_list(char *rawstring, char separator, List **sl);
-
+static Bitmapset *compile_origin_filter(List *origins);
+static JsonPrefixFilter *compile_prefix_filter(List *prefixes);
+static int	prefix_cmp(const void *a, const void *b);
+static bool pg_match_prefix(JsonPrefixFilter *pf, const char *prefix);
+
+static void pg_escape_json(StringInfo buf, const char *str);
+static void pg_escape_json_len(StringInfo buf, const char *str, int len);
+static void pg_append_lsn(JsonDecodingData *data, StringInfo buf, XLogRecPtr lsn);
+static int64 pg_timestamp_to_epoch(TimestampTz ts);
+static void pg_append_timestamp(JsonDecodingData *data, StringInfo buf, TimestampTz ts);
+static void pg_append_txn_fragment(LogicalDecodingContext *ctx, ReorderBufferTXN *txn);
 static bool pg_filter_by_action(int change_type, JsonAction actions);
+static void pg_build_relation_headers(JsonDecodingData *data, JsonRelationEntry *entry, char *schemaname, char *tablename);
+static int	pg_action_index(int change_type);
+static int	pg_reserve_output(JsonDecodingData *data, JsonRelationEntry *entry, StringInfo out);
+static void pg_account_output(JsonDecodingData *data, JsonRelationEntry *entry, StringInfo out, int start);
+static void pg_shard_init_entry(JsonDecodingData *data, JsonRelationEntry *entry, Relation relation);
+static bool pg_filter_by_shard(JsonDecodingData *data, JsonRelationEntry *entry, TupleDesc tupdesc, ReorderBufferChange *change, int *action);
+static uint32 pg_shard_hash(JsonRelationEntry *entry, TupleDesc tupdesc, HeapTuple tuple);
+static void pg_shard_route_change(ReorderBufferChange *change, int action);
+static bool pg_match_table(SelectTable *t, char *schemaname, char *tablename);
+static bool pg_match_pattern(const char *pattern, const char *str);
+static regex_t *compile_table_regex(char *pattern, char *defname);
+static bool pg_match_table_regex(regex_t *re, char *schemaname, char *tablename);
 static bool pg_filter_by_table(List *filter_tables, char *schemaname, char *tablename);
 static bool pg_add_by_table(List *add_tables, char *schemaname, char *tablename);
+static SelectTable *pg_actions_by_table(List *table_actions, char *schemaname, char *tablename);
+
+static void init_relation_cache(JsonDecodingData *data, MemoryContext parent);
+static JsonRelationEntry *get_relation_entry(JsonDecodingData *data, Relation relation);
+static void relation_cache_invalidate_cb(Datum arg, Oid relid);
+static void relation_cache_syscache_cb(Datum arg, int cacheid, uint32 hashvalue);
+static void relation_cache_type_cb(Datum arg, int cacheid, uint32 hashvalue);
+static void enum_cache_invalidate_cb(Datum arg, int cacheid, uint32 hashvalue);
+static void type_cache_invalidate_cb(Datum arg, int cacheid, uint32 hashvalue);
+static JsonTypeEntry *get_type_entry(JsonDecodingData *data, Oid typid);
+static bool parse_type_encoders(List *pairs, List **encoders);
+static JsonTypeEncoder *pg_find_type_encoder(JsonDecodingData *data, Oid typid);
+static JsonValueKind pg_value_kind(JsonDecodingData *data, Oid typid);
+static bool pg_elide_type(JsonDecodingData *data, Oid typid);
+static void pg_append_elided(StringInfo buf, JsonColumn *col, Datum value);
+static Size pg_varlena_data_size(Datum value);
+static void pg_append_encoded(StringInfo buf, JsonTypeEncoder *encoder, Datum value);
+#if PG_VERSION_NUM >= 130000
+static void pg_decode_change_via_root(LogicalDecodingContext *ctx,
+				 ReorderBufferTXN *txn, Relation relation,
+				 ReorderBufferChange *change);
+#endif
+#if PG_VERSION_NUM >= 100000
+static void load_publications(JsonDecodingData *data);
+static bool pg_publication_actions(JsonDecodingData *data, Relation relation, JsonAction *pubactions);
+static void publication_cache_cb(Datum arg, int cacheid, uint32 hashvalue);
+#endif
 
 /* version 1 */
 static void pg_decode_begin_txn_v1(LogicalDecodingContext *ctx,
@@ -184,12 +563,51 @@ static void pg_decode_begin_txn_v2(LogicalDecodingContext *ctx,
 					ReorderBufferTXN *txn);
 static void pg_decode_commit_txn_v2(LogicalDecodingContext *ctx,
 					 ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
-static void pg_decode_write_value(LogicalDecodingContext *ctx, Datum value, bool isnull, Oid typid);
-static void pg_decode_write_tuple(LogicalDecodingContext *ctx, Relation relation, HeapTuple tuple, PGOutputJsonKind kind);
+static JsonRelationEntry *get_column_plan(JsonDecodingData *data, Relation relation);
+static void pg_json_tuple_init(JsonTuple *jt, HeapTuple tuple);
+static void pg_json_tuple_fetch(JsonTuple *jt, TupleDesc tupdesc, JsonRelationEntry *entry, bool keys, bool identity);
+static void pg_json_tuple_write_value(LogicalDecodingContext *ctx, JsonTuple *jt, JsonColumn *col, bool key);
+static char *pg_column_default(Relation relation, Relation defrel, Form_pg_attribute attr);
+static void pg_build_column_fragments(JsonDecodingData *data, Form_pg_attribute attr, JsonColumn *col);
+static void pg_build_column_v1(JsonDecodingData *data, Form_pg_attribute attr, JsonColumn *col);
+static JsonValueKind pg_json_value_kind(Oid typid);
+static Oid	pg_hstore_to_json(Oid typid);
+static void pg_check_type_cache(JsonDecodingData *data);
+static void pg_encode_value(JsonDecodingData *data, StringInfo buf, Oid typid, JsonValueKind kind, FmgrInfo *outfunc, bool isvarlena, Datum value);
+static void pg_encode_nested(JsonDecodingData *data, StringInfo buf, Oid typid, Datum value, bool isnull);
+static void pg_append_array(JsonDecodingData *data, StringInfo buf, ArrayType *array);
+static void pg_append_array_dim(JsonDecodingData *data, StringInfo buf, Oid elemtype, int dim, int ndim, int *dims, Datum *values, bool *nulls, int *i);
+static void pg_append_composite(JsonDecodingData *data, StringInfo buf, HeapTupleHeader td);
+static void pg_append_range(JsonDecodingData *data, StringInfo buf, Datum value);
+static bool pg_encode_builtin(JsonDecodingData *data, StringInfo buf, Oid typid, JsonValueKind kind, Datum value);
+static bool pg_append_epoch(StringInfo buf, JsonValueKind kind, Datum value);
+static char *pg_put_digits(char *p, int value, int width);
+static char *pg_put_bc(char *p);
+static bool pg_append_iso_date(StringInfo buf, DateADT date);
+static bool pg_append_iso_timestamp(StringInfo buf, TimestampTz ts, bool withtz, bool utc);
+static void pg_append_uuid(StringInfo buf, pg_uuid_t *uuid);
+static void pg_append_enum(JsonDecodingData *data, StringInfo buf, Oid enumoid);
+static void pg_append_jsonb(StringInfo buf, JsonbContainer *container);
+static void pg_append_json(StringInfo buf, const char *p, int len);
+static void pg_append_jsonb_scalar(StringInfo buf, JsonbValue *v);
+static void pg_decode_write_value(LogicalDecodingContext *ctx, JsonColumn *col, Datum value, bool isnull, bool elide);
+static bool pg_elide_value(JsonDecodingData *data, JsonColumn *col, Datum value);
+static void pg_decode_write_tuple(LogicalDecodingContext *ctx, Relation relation, JsonTuple *jt, PGOutputJsonKind kind);
 static void pg_decode_write_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, Relation relation, ReorderBufferChange *change);
 static void pg_decode_change_v2(LogicalDecodingContext *ctx,
 				 ReorderBufferTXN *txn, Relation rel,
 				 ReorderBufferChange *change);
+static void pg_summary_count(JsonDecodingData *data, Relation relation, int idx);
+static void pg_decode_write_summary(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, XLogRecPtr commit_lsn);
+static void pg_compact_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, Relation relation, ReorderBufferChange *change);
+static void pg_compact_flush(LogicalDecodingContext *ctx, ReorderBufferTXN *txn);
+static void compact_reset(JsonCompactState *cs);
+static bool compact_build_key(Relation relation, HeapTuple tuple, JsonCompactKey *key);
+static uint32 compact_key_hash(const void *key, Size keysize);
+static int	compact_key_match(const void *key1, const void *key2, Size keysize);
+static void compact_store_tuple(JsonDecodingData *data, JsonCompactTuple *ct, HeapTuple tuple, TupleDesc tupdesc, bool merge);
+static void compact_clear_tuple(JsonCompactState *cs, JsonCompactTuple *ct);
+static HeapTuple compact_load_tuple(JsonCompactState *cs, JsonCompactTuple *ct, Oid relid);
 #if PG_VERSION_NUM >= 90600
 static void pg_decode_message_v2(LogicalDecodingContext *ctx,
 					ReorderBufferTXN *txn, XLogRecPtr lsn,
@@ -255,8 +673,24 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 	ListCell	*option;
 	JsonDecodingData *data;
 	SelectTable	*t;
+	bool		add_tables_set = false;
 
 	data = palloc0(sizeof(JsonDecodingData));
+
+	/*
+	 * Everything allocated for a change is freed at once after it is output
+	 * hence there is no point in keeping freelists. Bump contexts (17+) are
+	 * not used because output functions pfree() their chunks.
+	 */
+#if PG_VERSION_NUM >= 150000
+	data->context = GenerationContextCreate(TopMemoryContext,
+										"wal2json output context",
+										ALLOCSET_DEFAULT_SIZES);
+#elif PG_VERSION_NUM >= 110000
+	data->context = GenerationContextCreate(TopMemoryContext,
+										"wal2json output context",
+										SLAB_DEFAULT_BLOCK_SIZE);
+#else
 	data->context = AllocSetContextCreate(TopMemoryContext,
 										"wal2json output context",
 #if PG_VERSION_NUM >= 90600
@@ -265,6 +699,21 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 										ALLOCSET_DEFAULT_MINSIZE,
 										ALLOCSET_DEFAULT_INITSIZE,
 										ALLOCSET_DEFAULT_MAXSIZE
+#endif
+                                        );
+#endif
+	/*
+	 * Plugin state lives in ctx->context so it is freed with the decoding
+	 * context even if decoding errors out and shutdown is not called.
+	 */
+	data->txn_context = AllocSetContextCreate(ctx->context,
+										"wal2json transaction context",
+#if PG_VERSION_NUM >= 90600
+										ALLOCSET_DEFAULT_SIZES
+#else
+										ALLOCSET_DEFAULT_MINSIZE,
+										ALLOCSET_DEFAULT_INITSIZE,
+										ALLOCSET_DEFAULT_MAXSIZE
 #endif
                                         );
 	data->include_transaction = true;
@@ -279,15 +728,45 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 	data->include_domain_data_type = false;
 	data->include_column_positions = false;
 	data->numeric_data_types_as_string = false;
+	data->publish_via_partition_root = false;
+	data->keys_only = false;
+	data->compact_changes = false;
+	data->compact_memory_limit = 65536;
+	data->compact_state = NULL;
+	data->summary = false;
+	data->summary_state = NULL;
+	data->shard_count = 1;
+	data->shard_id = 0;
+	data->shard_by_table = false;
 	data->pretty_print = false;
 	data->write_in_chunks = false;
 	data->include_lsn = false;
+	data->numeric_lsn = false;
+	data->epoch_timestamp = false;
+	data->epoch_temporal = false;
+	data->utc_timestamptz = false;
+	data->embed_json = false;
+	data->structured_types = false;
 	data->include_not_null = false;
 	data->include_default = false;
 	data->filter_origins = NIL;
 	data->filter_tables = NIL;
+	data->table_actions = NIL;
+	data->filter_tables_regex = NULL;
+	data->add_tables_regex = NULL;
 	data->filter_msg_prefixes = NIL;
 	data->add_msg_prefixes = NIL;
+	data->type_encoders = NIL;
+	data->type_encoders_resolved = false;
+	data->max_value_size = 0;
+	data->elide_types = NIL;
+	data->elide_typids = NIL;
+	data->elide_types_resolved = false;
+	data->publication_names = NIL;
+	data->publications = NIL;
+	data->filter_origins_set = NULL;
+	data->filter_prefixes = NULL;
+	data->add_prefixes = NULL;
 
 	data->format_version = 1;
 
@@ -557,6 +1036,84 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
 							 strVal(elem->arg), elem->defname)));
 		}
+		else if (strcmp(elem->defname, "numeric-lsn") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "numeric-lsn argument is null");
+				data->numeric_lsn = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->numeric_lsn))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "epoch-timestamp") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "epoch-timestamp argument is null");
+				data->epoch_timestamp = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->epoch_timestamp))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "epoch-temporal") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "epoch-temporal argument is null");
+				data->epoch_temporal = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->epoch_temporal))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "utc-timestamptz") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "utc-timestamptz argument is null");
+				data->utc_timestamptz = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->utc_timestamptz))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "embed-json") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "embed-json argument is null");
+				data->embed_json = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->embed_json))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "structured-types") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "structured-types argument is null");
+				data->structured_types = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->structured_types))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
 		else if (strcmp(elem->defname, "include-unchanged-toast") == 0)
 		{
 			ereport(ERROR,
@@ -671,6 +1228,7 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 			 */
 			list_free_deep(data->add_tables);
 			data->add_tables = NIL;
+			add_tables_set = true;
 
 			if (elem->arg == NULL)
 			{
@@ -691,6 +1249,49 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 				pfree(rawstr);
 			}
 		}
+		else if (strcmp(elem->defname, "filter-tables-regex") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "filter-tables-regex argument is null");
+				data->filter_tables_regex = NULL;
+			}
+			else
+				data->filter_tables_regex = compile_table_regex(strVal(elem->arg), elem->defname);
+		}
+		else if (strcmp(elem->defname, "add-tables-regex") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "add-tables-regex argument is null");
+				data->add_tables_regex = NULL;
+			}
+			else
+				data->add_tables_regex = compile_table_regex(strVal(elem->arg), elem->defname);
+		}
+		else if (strcmp(elem->defname, "table-actions") == 0)
+		{
+			char	*rawstr;
+
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "table-actions argument is null");
+				data->table_actions = NIL;
+			}
+			else
+			{
+				rawstr = pstrdup(strVal(elem->arg));
+				if (!string_to_SelectTableAction(rawstr, ',', &data->table_actions))
+				{
+					pfree(rawstr);
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_NAME),
+							 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+								 strVal(elem->arg), elem->defname)));
+				}
+				pfree(rawstr);
+			}
+		}
 		else if (strcmp(elem->defname, "filter-msg-prefixes") == 0)
 		{
 			char	*rawstr;
@@ -737,362 +1338,3301 @@ pg_decode_startup(LogicalDecodingContext *ctx, OutputPluginOptions *opt, bool is
 				pfree(rawstr);
 			}
 		}
-		else if (strcmp(elem->defname, "format-version") == 0)
+		else if (strcmp(elem->defname, "type-encoders") == 0)
 		{
+			char	*rawstr;
+			List	*pairs = NIL;
+
 			if (elem->arg == NULL)
 			{
-				elog(DEBUG1, "format-version argument is null");
-				data->format_version = WAL2JSON_FORMAT_VERSION;
+				elog(DEBUG1, "type-encoders argument is null");
+				data->type_encoders = NIL;
 			}
-			else if (!parse_int(strVal(elem->arg), &data->format_version, 0, NULL))
+			else
+			{
+				rawstr = pstrdup(strVal(elem->arg));
+				if (!split_string_to_list(rawstr, ',', &pairs) ||
+					!parse_type_encoders(pairs, &data->type_encoders))
+				{
+					pfree(rawstr);
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_NAME),
+							 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+								 strVal(elem->arg), elem->defname)));
+				}
+				list_free_deep(pairs);
+				pfree(rawstr);
+			}
+		}
+		else if (strcmp(elem->defname, "max-value-size") == 0)
+		{
+			if (elem->arg == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("parameter \"%s\" requires a value", elem->defname)));
+			else if (!parse_int(strVal(elem->arg), &data->max_value_size, 0, NULL) ||
+					 data->max_value_size < 0)
 				ereport(ERROR,
 						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
 						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
 							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "elide-types") == 0)
+		{
+			char	*rawstr;
 
-			if (data->format_version > WAL2JSON_FORMAT_VERSION)
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						 errmsg("client sent format_version=%d but we only support format %d or lower",
-						 data->format_version, WAL2JSON_FORMAT_VERSION)));
-
-			if (data->format_version < WAL2JSON_FORMAT_MIN_VERSION)
-				ereport(ERROR,
-						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
-						 errmsg("client sent format_version=%d but we only support format %d or higher",
-						 data->format_version, WAL2JSON_FORMAT_MIN_VERSION)));
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "elide-types argument is null");
+				data->elide_types = NIL;
+			}
+			else
+			{
+				rawstr = pstrdup(strVal(elem->arg));
+				if (!split_string_to_list(rawstr, ',', &data->elide_types))
+				{
+					pfree(rawstr);
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_NAME),
+							 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+								 strVal(elem->arg), elem->defname)));
+				}
+				pfree(rawstr);
+			}
 		}
-		else
+		else if (strcmp(elem->defname, "publication-names") == 0)
 		{
+#if PG_VERSION_NUM >= 100000
+			char	*rawstr;
+
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "publication-names argument is null");
+				data->publication_names = NIL;
+			}
+			else
+			{
+				rawstr = pstrdup(strVal(elem->arg));
+				if (!split_string_to_list(rawstr, ',', &data->publication_names))
+				{
+					pfree(rawstr);
+					ereport(ERROR,
+							(errcode(ERRCODE_INVALID_NAME),
+							 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+								 strVal(elem->arg), elem->defname)));
+				}
+				pfree(rawstr);
+			}
+#else
 			ereport(ERROR,
-					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
-					 errmsg("option \"%s\" = \"%s\" is unknown",
-						elem->defname,
-						elem->arg ? strVal(elem->arg) : "(null)")));
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("parameter \"%s\" requires PostgreSQL 10 or later",
+						 elem->defname)));
+#endif
 		}
-	}
-
-	elog(DEBUG2, "format version: %d", data->format_version);
-}
-
-/* cleanup this plugin's resources */
-static void
-pg_decode_shutdown(LogicalDecodingContext *ctx)
-{
-	JsonDecodingData *data = ctx->output_plugin_private;
-
-	/* cleanup our own resources via memory context reset */
-	MemoryContextDelete(data->context);
-}
+		else if (strcmp(elem->defname, "keys-only") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "keys-only argument is null");
+				data->keys_only = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->keys_only))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "shard-count") == 0)
+		{
+			if (elem->arg == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("parameter \"%s\" requires a value", elem->defname)));
+			else if (!parse_int(strVal(elem->arg), &data->shard_count, 0, NULL) ||
+					 data->shard_count < 1)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "shard-id") == 0)
+		{
+			if (elem->arg == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("parameter \"%s\" requires a value", elem->defname)));
+			else if (!parse_int(strVal(elem->arg), &data->shard_id, 0, NULL) ||
+					 data->shard_id < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "shard-by") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "shard-by argument is null");
+				data->shard_by_table = false;
+			}
+			else if (strcmp(strVal(elem->arg), "key") == 0)
+				data->shard_by_table = false;
+			else if (strcmp(strVal(elem->arg), "table") == 0)
+				data->shard_by_table = true;
+			else
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "summary") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "summary argument is null");
+				data->summary = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->summary))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "compact-changes") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "compact-changes argument is null");
+				data->compact_changes = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->compact_changes))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "compact-memory-limit") == 0)
+		{
+			if (elem->arg == NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("parameter \"%s\" requires a value", elem->defname)));
+			else if (!parse_int(strVal(elem->arg), &data->compact_memory_limit, 0, NULL) ||
+					 data->compact_memory_limit < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+		}
+		else if (strcmp(elem->defname, "publish-via-partition-root") == 0)
+		{
+#if PG_VERSION_NUM >= 130000
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "publish-via-partition-root argument is null");
+				data->publish_via_partition_root = true;
+			}
+			else if (!parse_bool(strVal(elem->arg), &data->publish_via_partition_root))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+#else
+			ereport(ERROR,
+					(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+					 errmsg("parameter \"%s\" requires PostgreSQL 13 or later",
+						 elem->defname)));
+#endif
+		}
+		else if (strcmp(elem->defname, "format-version") == 0)
+		{
+			if (elem->arg == NULL)
+			{
+				elog(DEBUG1, "format-version argument is null");
+				data->format_version = WAL2JSON_FORMAT_VERSION;
+			}
+			else if (!parse_int(strVal(elem->arg), &data->format_version, 0, NULL))
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("could not parse value \"%s\" for parameter \"%s\"",
+							 strVal(elem->arg), elem->defname)));
+
+			if (data->format_version > WAL2JSON_FORMAT_VERSION)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("client sent format_version=%d but we only support format %d or lower",
+						 data->format_version, WAL2JSON_FORMAT_VERSION)));
+
+			if (data->format_version < WAL2JSON_FORMAT_MIN_VERSION)
+				ereport(ERROR,
+						(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+						 errmsg("client sent format_version=%d but we only support format %d or higher",
+						 data->format_version, WAL2JSON_FORMAT_MIN_VERSION)));
+		}
+		else
+		{
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("option \"%s\" = \"%s\" is unknown",
+						elem->defname,
+						elem->arg ? strVal(elem->arg) : "(null)")));
+		}
+	}
+
+	if (data->keys_only && data->format_version != 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("parameter \"%s\" requires format version 2", "keys-only")));
+	if (data->compact_changes && data->format_version != 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("parameter \"%s\" requires format version 2", "compact-changes")));
+	if (data->summary && data->format_version != 2)
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("parameter \"%s\" requires format version 2", "summary")));
+
+	if (data->shard_id >= data->shard_count)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("parameter \"%s\" must be less than parameter \"%s\" (%d)",
+					 "shard-id", "shard-count", data->shard_count)));
+
+	/* summary outputs no changes */
+	if (data->summary)
+		data->compact_changes = false;
+
+	if (data->summary)
+	{
+		JsonSummaryState *ss = palloc0(sizeof(JsonSummaryState));
+
+		ss->context = AllocSetContextCreate(ctx->context,
+										"wal2json summary context",
+#if PG_VERSION_NUM >= 90600
+										ALLOCSET_DEFAULT_SIZES
+#else
+										ALLOCSET_DEFAULT_MINSIZE,
+										ALLOCSET_DEFAULT_INITSIZE,
+										ALLOCSET_DEFAULT_MAXSIZE
+#endif
+                                        );
+		data->summary_state = ss;
+	}
+
+	if (data->compact_changes)
+	{
+		JsonCompactState *cs = palloc0(sizeof(JsonCompactState));
+
+		cs->context = AllocSetContextCreate(ctx->context,
+										"wal2json compaction context",
+#if PG_VERSION_NUM >= 90600
+										ALLOCSET_DEFAULT_SIZES
+#else
+										ALLOCSET_DEFAULT_MINSIZE,
+										ALLOCSET_DEFAULT_INITSIZE,
+										ALLOCSET_DEFAULT_MAXSIZE
+#endif
+                                        );
+		cs->output_context = AllocSetContextCreate(ctx->context,
+										"wal2json compaction output context",
+#if PG_VERSION_NUM >= 90600
+										ALLOCSET_DEFAULT_SIZES
+#else
+										ALLOCSET_DEFAULT_MINSIZE,
+										ALLOCSET_DEFAULT_INITSIZE,
+										ALLOCSET_DEFAULT_MAXSIZE
+#endif
+                                        );
+		data->compact_state = cs;
+	}
+
+	/*
+	 * If only add-tables-regex is specified, remove 'all tables in all
+	 * schemas' value from list.
+	 */
+	if (data->add_tables_regex != NULL && !add_tables_set)
+	{
+		list_free_deep(data->add_tables);
+		data->add_tables = NIL;
+	}
+
+	/* origin and message prefix filters are checked for every change */
+	data->filter_origins_set = compile_origin_filter(data->filter_origins);
+	data->filter_prefixes = compile_prefix_filter(data->filter_msg_prefixes);
+	data->add_prefixes = compile_prefix_filter(data->add_msg_prefixes);
+
+	elog(DEBUG2, "format version: %d", data->format_version);
+
+	init_relation_cache(data, ctx->context);
+}
+
+/* cleanup this plugin's resources */
+static void
+pg_decode_shutdown(LogicalDecodingContext *ctx)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+
+	elog(DEBUG1, "output enlarged before " UINT64_FORMAT " changes and during " UINT64_FORMAT " changes", data->nr_reserved, data->nr_enlarged);
+
+	/* relation, enum and type caches live in cache_context */
+	JsonRelationCache = NULL;
+	JsonEnumCache = NULL;
+	JsonTypeCache = NULL;
+
+	if (data->filter_tables_regex != NULL)
+		pg_regfree(data->filter_tables_regex);
+	if (data->add_tables_regex != NULL)
+		pg_regfree(data->add_tables_regex);
+
+	/* cleanup our own resources via memory context reset */
+	MemoryContextDelete(data->context);
+	MemoryContextDelete(data->txn_context);
+	MemoryContextDelete(data->cache_context);
+	if (data->compact_state != NULL)
+	{
+		MemoryContextDelete(data->compact_state->context);
+		MemoryContextDelete(data->compact_state->output_context);
+	}
+	if (data->summary_state != NULL)
+		MemoryContextDelete(data->summary_state->context);
+}
+
+#if PG_VERSION_NUM >= 90500
+/* Caches are gone with cache_context; invalidation callbacks must not use them */
+static void
+relation_cache_reset_cb(void *arg)
+{
+	JsonRelationCache = NULL;
+	JsonEnumCache = NULL;
+	JsonTypeCache = NULL;
+}
+#endif
+
+/*
+ * Initialize the relation cache. Callbacks cannot be unregistered hence they
+ * are registered only once per backend; they do nothing if there is no cache.
+ */
+static void
+init_relation_cache(JsonDecodingData *data, MemoryContext parent)
+{
+	HASHCTL		ctl;
+	static bool	callbacks_registered = false;
+#if PG_VERSION_NUM >= 90500
+	MemoryContextCallback *cb;
+#else
+	/* without reset callbacks, caches must outlive the decoding context */
+	parent = TopMemoryContext;
+#endif
+
+	data->cache_context = AllocSetContextCreate(parent,
+										"wal2json relation cache",
+#if PG_VERSION_NUM >= 90600
+										ALLOCSET_DEFAULT_SIZES
+#else
+										ALLOCSET_DEFAULT_MINSIZE,
+										ALLOCSET_DEFAULT_INITSIZE,
+										ALLOCSET_DEFAULT_MAXSIZE
+#endif
+                                        );
+#if PG_VERSION_NUM >= 90500
+	cb = MemoryContextAlloc(data->cache_context, sizeof(MemoryContextCallback));
+	cb->func = relation_cache_reset_cb;
+	cb->arg = NULL;
+	MemoryContextRegisterResetCallback(data->cache_context, cb);
+#endif
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(JsonRelationEntry);
+	ctl.hcxt = data->cache_context;
+#if PG_VERSION_NUM >= 90500
+	JsonRelationCache = hash_create("wal2json relation cache", 128, &ctl,
+									HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#else
+	ctl.hash = oid_hash;
+	JsonRelationCache = hash_create("wal2json relation cache", 128, &ctl,
+									HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+#endif
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(JsonEnumEntry);
+	ctl.hcxt = data->cache_context;
+#if PG_VERSION_NUM >= 90500
+	JsonEnumCache = hash_create("wal2json enum cache", 64, &ctl,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#else
+	ctl.hash = oid_hash;
+	JsonEnumCache = hash_create("wal2json enum cache", 64, &ctl,
+								HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+#endif
+
+	/* type cache is created on first use */
+	data->type_context = AllocSetContextCreate(data->cache_context,
+										"wal2json type cache",
+#if PG_VERSION_NUM >= 90600
+										ALLOCSET_SMALL_SIZES
+#else
+										ALLOCSET_SMALL_MINSIZE,
+										ALLOCSET_SMALL_INITSIZE,
+										ALLOCSET_SMALL_MAXSIZE
+#endif
+                                        );
+	JsonTypeCacheValid = false;
+
+#if PG_VERSION_NUM >= 100000
+	/* GetPublicationByName() allocates more than the Publication */
+	data->publication_context = AllocSetContextCreate(data->cache_context,
+										"wal2json publications",
+										ALLOCSET_SMALL_SIZES);
+#endif
+	JsonPublicationsValid = false;
+	JsonRelationCacheHasRoots = false;
+
+	if (!callbacks_registered)
+	{
+		CacheRegisterRelcacheCallback(relation_cache_invalidate_cb, (Datum) 0);
+		/* schema names are used by table filters */
+		CacheRegisterSyscacheCallback(NAMESPACEOID, relation_cache_syscache_cb, (Datum) 0);
+		/* type names are in the column plans */
+		CacheRegisterSyscacheCallback(TYPEOID, relation_cache_type_cb, (Datum) 0);
+		/* enum labels (ALTER TYPE ... RENAME VALUE) */
+		CacheRegisterSyscacheCallback(ENUMOID, enum_cache_invalidate_cb, (Datum) 0);
+		CacheRegisterSyscacheCallback(TYPEOID, type_cache_invalidate_cb, (Datum) 0);
+#if PG_VERSION_NUM >= 100000
+		/* publication-names */
+		CacheRegisterSyscacheCallback(PUBLICATIONOID, publication_cache_cb, (Datum) 0);
+		CacheRegisterSyscacheCallback(PUBLICATIONRELMAP, publication_cache_cb, (Datum) 0);
+#endif
+#if PG_VERSION_NUM >= 150000
+		CacheRegisterSyscacheCallback(PUBLICATIONNAMESPACEMAP, publication_cache_cb, (Datum) 0);
+#endif
+		callbacks_registered = true;
+	}
+}
+
+/*
+ * Get the relation entry, building it if it is new or was invalidated. Names
+ * are looked up only here; the caller's memory context is used for them.
+ */
+static JsonRelationEntry *
+get_relation_entry(JsonDecodingData *data, Relation relation)
+{
+	JsonRelationEntry	*entry;
+	Oid					relid = RelationGetRelid(relation);
+	bool				found;
+	char				*schemaname;
+	char				*tablename;
+	SelectTable			*t;
+
+	Assert(JsonRelationCache != NULL);
+
+	entry = (JsonRelationEntry *) hash_search(JsonRelationCache, (void *) &relid, HASH_ENTER, &found);
+	if (found && entry->valid)
+		return entry;
+
+	/* it is not valid until it is completely built */
+	entry->valid = false;
+
+	if (!found)
+	{
+		entry->avgsize = 0;
+		entry->maxsize = 0;
+		memset(entry->header, 0, sizeof(entry->header));
+		entry->names = NULL;
+		entry->map = NULL;
+		entry->shardkeys = NULL;
+		entry->shardprocs = NULL;
+		entry->shardcolls = NULL;
+		entry->plan_context = NULL;
+	}
+	else if (entry->map != NULL)
+	{
+		FreeTupleDesc(entry->map->indesc);
+		FreeTupleDesc(entry->map->outdesc);
+		free_conversion_map(entry->map);
+		entry->map = NULL;
+	}
+	entry->publish_as_relid = relid;
+
+	if (entry->plan_context != NULL)
+	{
+		MemoryContextDelete(entry->plan_context);
+		entry->plan_context = NULL;
+	}
+	entry->ncolumns = 0;
+	entry->columns = NULL;
+
+	if (data->shard_count > 1)
+		pg_shard_init_entry(data, entry, relation);
+
+#if PG_VERSION_NUM >= 130000
+	/*
+	 * Partition changes are output as changes of the topmost ancestor. Tuples
+	 * are converted if the column order differs.
+	 */
+	if (data->publish_via_partition_root && relation->rd_rel->relispartition)
+	{
+		List		*ancestors = get_partition_ancestors(relid);
+		Relation	ancestor;
+		TupleDesc	indesc;
+		TupleDesc	outdesc;
+		MemoryContext	old;
+
+		entry->publish_as_relid = llast_oid(ancestors);
+
+		ancestor = RelationIdGetRelation(entry->publish_as_relid);
+		if (!RelationIsValid(ancestor))
+			elog(ERROR, "could not open relation with OID %u", entry->publish_as_relid);
+
+		old = MemoryContextSwitchTo(data->cache_context);
+		indesc = CreateTupleDescCopy(RelationGetDescr(relation));
+		outdesc = CreateTupleDescCopy(RelationGetDescr(ancestor));
+		entry->map = convert_tuples_by_name(indesc, outdesc);
+		/* same column layout: no map hence the copies are not kept */
+		if (entry->map == NULL)
+		{
+			FreeTupleDesc(indesc);
+			FreeTupleDesc(outdesc);
+		}
+		MemoryContextSwitchTo(old);
+
+		RelationClose(ancestor);
+
+		JsonRelationCacheHasRoots = true;
+	}
+#endif
+
+	/* schema and table names are used for chosen tables */
+	schemaname = get_namespace_name(RelationGetNamespace(relation));
+	tablename = RelationGetRelationName(relation);
+
+	/* a renamed table or schema rebuilds the entry */
+	pg_build_relation_headers(data, entry, schemaname, tablename);
+
+	/*
+	 * Excluded tables take precedence over added tables. Regular expressions
+	 * are evaluated only here, hence once per relation.
+	 */
+	if (pg_filter_by_table(data->filter_tables, schemaname, tablename) ||
+		pg_match_table_regex(data->filter_tables_regex, schemaname, tablename))
+		entry->selected = false;
+	else
+		entry->selected = pg_add_by_table(data->add_tables, schemaname, tablename) ||
+							pg_match_table_regex(data->add_tables_regex, schemaname, tablename);
+
+	/* actions for this table, if any; otherwise, the global ones */
+	t = pg_actions_by_table(data->table_actions, schemaname, tablename);
+	if (t != NULL)
+		entry->actions = t->actions;
+	else
+		entry->actions = data->actions;
+
+#if PG_VERSION_NUM >= 100000
+	/* the table must also be published and only published actions are output */
+	if (data->publication_names != NIL && entry->selected)
+	{
+		JsonAction	pubactions;
+
+		if (pg_publication_actions(data, relation, &pubactions))
+		{
+			entry->actions.insert = entry->actions.insert && pubactions.insert;
+			entry->actions.update = entry->actions.update && pubactions.update;
+			entry->actions.delete = entry->actions.delete && pubactions.delete;
+			entry->actions.truncate = entry->actions.truncate && pubactions.truncate;
+		}
+		else
+			entry->selected = false;
+	}
+#endif
+
+	entry->valid = true;
+
+	return entry;
+}
+
+/* Relcache invalidation callback */
+static void
+relation_cache_invalidate_cb(Datum arg, Oid relid)
+{
+	JsonRelationEntry	*entry;
+
+	if (JsonRelationCache == NULL)
+		return;
+
+	/* invalid relid means all relations */
+	if (OidIsValid(relid))
+	{
+		entry = (JsonRelationEntry *) hash_search(JsonRelationCache, (void *) &relid, HASH_FIND, NULL);
+		if (entry != NULL)
+			entry->valid = false;
+
+		/* partitions that are output as this relation */
+		if (JsonRelationCacheHasRoots)
+		{
+			HASH_SEQ_STATUS		status;
+
+			hash_seq_init(&status, JsonRelationCache);
+			while ((entry = (JsonRelationEntry *) hash_seq_search(&status)) != NULL)
+			{
+				if (entry->publish_as_relid == relid)
+					entry->valid = false;
+			}
+		}
+	}
+	else
+	{
+		HASH_SEQ_STATUS		status;
+
+		hash_seq_init(&status, JsonRelationCache);
+		while ((entry = (JsonRelationEntry *) hash_seq_search(&status)) != NULL)
+			entry->valid = false;
+	}
+}
+
+/*
+ * Syscache invalidation callback. A renamed schema does not invalidate the
+ * relations that use it hence rebuild all of them.
+ */
+static void
+relation_cache_syscache_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	relation_cache_invalidate_cb(arg, InvalidOid);
+}
+
+/*
+ * A renamed type does not invalidate the relations that use it either. Only
+ * the relations whose column plan has a column of that type are rebuilt; zero
+ * hash value means all types.
+ */
+static void
+relation_cache_type_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	HASH_SEQ_STATUS		status;
+	JsonRelationEntry	*entry;
+	int					i;
+
+	if (JsonRelationCache == NULL)
+		return;
+
+	hash_seq_init(&status, JsonRelationCache);
+	while ((entry = (JsonRelationEntry *) hash_seq_search(&status)) != NULL)
+	{
+		/* type names are only in the column plan */
+		if (entry->columns == NULL)
+			continue;
+
+		for (i = 0; i < entry->ncolumns; i++)
+		{
+			if (hashvalue == 0 || entry->columns[i].typhash == hashvalue)
+			{
+				entry->valid = false;
+				break;
+			}
+		}
+	}
+}
+
+/* Forget all enum labels */
+static void
+enum_cache_invalidate_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	HASH_SEQ_STATUS	status;
+	JsonEnumEntry	*entry;
+
+	if (JsonEnumCache == NULL)
+		return;
+
+	hash_seq_init(&status, JsonEnumCache);
+	while ((entry = (JsonEnumEntry *) hash_seq_search(&status)) != NULL)
+	{
+		pfree(entry->label);
+		if (hash_search(JsonEnumCache, (void *) &entry->enumoid, HASH_REMOVE, NULL) == NULL)
+			elog(ERROR, "hash table corrupted");
+	}
+}
+
+/*
+ * Entries are removed when the next value is written because callers might
+ * hold entries while they encode a value.
+ */
+static void
+type_cache_invalidate_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	JsonTypeCacheValid = false;
+}
+
+/* Get the type entry, building it if it is new */
+static JsonTypeEntry *
+get_type_entry(JsonDecodingData *data, Oid typid)
+{
+	JsonTypeEntry	*entry;
+	JsonTypeEntry	tmp;
+	Oid				typoutput;
+
+	Assert(JsonTypeCache != NULL);
+
+	entry = (JsonTypeEntry *) hash_search(JsonTypeCache, (void *) &typid, HASH_FIND, NULL);
+	if (entry != NULL)
+		return entry;
+
+	/* catalog lookups can run invalidation callbacks, enter afterwards */
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.kind = pg_value_kind(data, typid);
+	getTypeOutputInfo(typid, &typoutput, &tmp.isvarlena);
+	fmgr_info_cxt(typoutput, &tmp.outfunc, data->type_context);
+	get_typlenbyvalalign(typid, &tmp.typlen, &tmp.typbyval, &tmp.typalign);
+	if (tmp.kind == JSON_VALUE_CUSTOM)
+		tmp.encoder = pg_find_type_encoder(data, typid);
+	else if (tmp.kind == JSON_VALUE_HSTORE)
+	{
+		tmp.encoder = MemoryContextAllocZero(data->type_context, sizeof(JsonTypeEncoder));
+		tmp.encoder->typid = typid;
+		tmp.encoder->rettype = JSONOID;
+		fmgr_info_cxt(pg_hstore_to_json(typid), &tmp.encoder->flinfo, data->type_context);
+	}
+
+	entry = (JsonTypeEntry *) hash_search(JsonTypeCache, (void *) &typid, HASH_ENTER, NULL);
+	tmp.typid = typid;
+	*entry = tmp;
+
+	return entry;
+}
+
+/*
+ * Split "type:function" pairs. Names are looked up later because there is
+ * no transaction at startup.
+ */
+static bool
+parse_type_encoders(List *pairs, List **encoders)
+{
+	ListCell	*lc;
+
+	foreach(lc, pairs)
+	{
+		char			*str = lfirst(lc);
+		char			*sep;
+		JsonTypeEncoder	*enc;
+
+		sep = strchr(str, ':');
+		if (sep == NULL || sep == str || sep[1] == '\0')
+			return false;
+
+		enc = palloc0(sizeof(JsonTypeEncoder));
+		enc->typname = pnstrdup(str, sep - str);
+		enc->funcname = pstrdup(sep + 1);
+
+		/* search_path of the walsender is not the one the function was created with */
+#if PG_VERSION_NUM >= 160000
+		if (list_length(stringToQualifiedNameList(enc->funcname, NULL)) < 2)
+#else
+		if (list_length(stringToQualifiedNameList(enc->funcname)) < 2)
+#endif
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("type encoder \"%s\" must be schema-qualified", enc->funcname)));
+
+		*encoders = lappend(*encoders, enc);
+	}
+
+	return true;
+}
+
+/*
+ * Return the encoder of this type or NULL. The first call looks up the types
+ * and functions of type-encoders.
+ */
+static JsonTypeEncoder *
+pg_find_type_encoder(JsonDecodingData *data, Oid typid)
+{
+	ListCell	*lc;
+
+	if (data->type_encoders == NIL)
+		return NULL;
+
+	if (!data->type_encoders_resolved)
+	{
+		foreach(lc, data->type_encoders)
+		{
+			JsonTypeEncoder	*enc = lfirst(lc);
+			List			*funcname;
+			Oid				funcid;
+
+			/* types are found through search_path, like elide-types */
+			enc->typid = DatumGetObjectId(DirectFunctionCall1(regtypein, CStringGetDatum(enc->typname)));
+#if PG_VERSION_NUM >= 160000
+			funcname = stringToQualifiedNameList(enc->funcname, NULL);
+#else
+			funcname = stringToQualifiedNameList(enc->funcname);
+#endif
+			funcid = LookupFuncName(funcname, 1, &enc->typid, false);
+			enc->rettype = get_func_rettype(funcid);
+			if (enc->rettype != JSONOID && enc->rettype != JSONBOID &&
+				enc->rettype != TEXTOID && enc->rettype != BYTEAOID)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("type encoder \"%s\" must return json, jsonb, text or bytea", enc->funcname)));
+			fmgr_info_cxt(funcid, &enc->flinfo, data->cache_context);
+		}
+		data->type_encoders_resolved = true;
+	}
+
+	foreach(lc, data->type_encoders)
+	{
+		JsonTypeEncoder	*enc = lfirst(lc);
+
+		if (enc->typid == typid)
+			return enc;
+	}
+
+	return NULL;
+}
+
+/*
+ * Are values of this type (or of the base type of this domain) elided? The
+ * first call looks up the types of elide-types.
+ */
+static bool
+pg_elide_type(JsonDecodingData *data, Oid typid)
+{
+	ListCell	*lc;
+
+	if (data->elide_types == NIL)
+		return false;
+
+	if (!data->elide_types_resolved)
+	{
+		MemoryContext old;
+
+		old = MemoryContextSwitchTo(data->cache_context);
+		foreach(lc, data->elide_types)
+			data->elide_typids = lappend_oid(data->elide_typids,
+						DatumGetObjectId(DirectFunctionCall1(regtypein, CStringGetDatum(lfirst(lc)))));
+		MemoryContextSwitchTo(old);
+		data->elide_types_resolved = true;
+	}
+
+	return list_member_oid(data->elide_typids, typid) ||
+		list_member_oid(data->elide_typids, getBaseType(typid));
+}
+
+/* Start over if pg_type changed. Call it before any entry is used. */
+static void
+pg_check_type_cache(JsonDecodingData *data)
+{
+	HASHCTL		ctl;
+
+	if (JsonTypeCache != NULL && JsonTypeCacheValid)
+		return;
+
+	MemoryContextReset(data->type_context);
+
+	memset(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(Oid);
+	ctl.entrysize = sizeof(JsonTypeEntry);
+	ctl.hcxt = data->type_context;
+#if PG_VERSION_NUM >= 90500
+	JsonTypeCache = hash_create("wal2json type cache", 32, &ctl,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#else
+	ctl.hash = oid_hash;
+	JsonTypeCache = hash_create("wal2json type cache", 32, &ctl,
+								HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+#endif
+	JsonTypeCacheValid = true;
+}
+
+/*
+ * Find out how changes of this relation are sharded: by primary key or replica
+ * identity (if the old tuple has it) using the type hash functions, or by
+ * table if there is no key or a key column has no hash function.
+ */
+static void
+pg_shard_init_entry(JsonDecodingData *data, JsonRelationEntry *entry, Relation relation)
+{
+	TupleDesc		tupdesc = RelationGetDescr(relation);
+	Bitmapset		*bs = NULL;
+	MemoryContext	old;
+	int				x;
+	int				n = 0;
+
+	if (entry->shardkeys != NULL)
+	{
+		pfree(entry->shardkeys);
+		pfree(entry->shardprocs);
+		pfree(entry->shardcolls);
+		entry->shardkeys = NULL;
+		entry->shardprocs = NULL;
+		entry->shardcolls = NULL;
+	}
+
+	entry->tablehash = DatumGetUInt32(hash_uint32((uint32) RelationGetRelid(relation)));
+	entry->nshardkeys = 0;
+
+	if (data->shard_by_table)
+		return;
+
+	/* make sure rd_pkindex and rd_replidindex are set */
+	RelationGetIndexList(relation);
+
+	if (OidIsValid(relation->rd_replidindex))
+		bs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_IDENTITY_KEY);
+#if PG_VERSION_NUM >= 100000
+	else if (relation->rd_rel->relreplident == REPLICA_IDENTITY_FULL && OidIsValid(relation->rd_pkindex))
+		bs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_PRIMARY_KEY);
+#endif
+
+	if (bs == NULL)
+		return;
+
+	old = MemoryContextSwitchTo(data->cache_context);
+	entry->shardkeys = (AttrNumber *) palloc(bms_num_members(bs) * sizeof(AttrNumber));
+	entry->shardprocs = (FmgrInfo *) palloc(bms_num_members(bs) * sizeof(FmgrInfo));
+	entry->shardcolls = (Oid *) palloc(bms_num_members(bs) * sizeof(Oid));
+
+#if PG_VERSION_NUM >= 90500
+	x = -1;
+	while ((x = bms_next_member(bs, x)) >= 0)
+#else
+	while ((x = bms_first_member(bs)) >= 0)
+#endif
+	{
+		AttrNumber			attnum = x + FirstLowInvalidHeapAttributeNumber;
+		Form_pg_attribute	attr;
+		TypeCacheEntry		*typentry;
+
+		if (attnum <= 0)
+			continue;
+
+#if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
+		attr = tupdesc->attrs[attnum - 1];
+#else
+		attr = TupleDescAttr(tupdesc, attnum - 1);
+#endif
+
+		typentry = lookup_type_cache(attr->atttypid, TYPECACHE_HASH_PROC_FINFO);
+		if (!OidIsValid(typentry->hash_proc_finfo.fn_oid))
+		{
+			elog(DEBUG1, "column \"%s\" has no hash function, table \"%s\" is sharded by table",
+				 NameStr(attr->attname), RelationGetRelationName(relation));
+			n = 0;
+			break;
+		}
+
+		entry->shardkeys[n] = attnum;
+		fmgr_info_copy(&entry->shardprocs[n], &typentry->hash_proc_finfo, data->cache_context);
+		entry->shardcolls[n] = attr->attcollation;
+		n++;
+	}
+	MemoryContextSwitchTo(old);
+
+	entry->nshardkeys = n;
+
+	bms_free(bs);
+}
+
+/*
+ * Turn an UPDATE into the DELETE of the old row or the INSERT of the new row.
+ * Unchanged TOAST values are not in the new row.
+ */
+static void
+pg_shard_route_change(ReorderBufferChange *change, int action)
+{
+	change->action = action;
+	if (action == REORDER_BUFFER_CHANGE_DELETE)
+		change->data.tp.newtuple = NULL;
+	else
+		change->data.tp.oldtuple = NULL;
+}
+
+/* Hash of the shard key of this tuple, or of the table if there is no key */
+static uint32
+pg_shard_hash(JsonRelationEntry *entry, TupleDesc tupdesc, HeapTuple tuple)
+{
+	uint32		hash = 0;
+	int			i;
+
+	if (tuple == NULL)
+		return entry->tablehash;
+
+	for (i = 0; i < entry->nshardkeys; i++)
+	{
+		Datum	value;
+		bool	isnull;
+		uint32	h = 0;
+
+		value = heap_getattr(tuple, entry->shardkeys[i], tupdesc, &isnull);
+		if (!isnull)
+			h = DatumGetUInt32(FunctionCall1Coll(&entry->shardprocs[i], entry->shardcolls[i], value));
+
+		/* same as hash_combine() */
+		hash ^= h + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	}
+
+	return hash;
+}
+
+/*
+ * Is this change in another shard? The key of the old tuple is used for a
+ * DELETE. An UPDATE that changes the key can move the row to another shard:
+ * it is a DELETE in the old key's shard and an INSERT in the new key's
+ * shard. *action is set to the action that this shard outputs.
+ */
+static bool
+pg_filter_by_shard(JsonDecodingData *data, JsonRelationEntry *entry, TupleDesc tupdesc, ReorderBufferChange *change, int *action)
+{
+	HeapTuple	newtuple = NULL;
+	HeapTuple	oldtuple = NULL;
+	bool		inold;
+	bool		innew;
+
+	*action = change->action;
+
+	if (entry->nshardkeys > 0)
+	{
+#if PG_VERSION_NUM >= 170000
+		oldtuple = change->data.tp.oldtuple;
+		newtuple = change->data.tp.newtuple;
+#else
+		if (change->data.tp.oldtuple != NULL)
+			oldtuple = &change->data.tp.oldtuple->tuple;
+		if (change->data.tp.newtuple != NULL)
+			newtuple = &change->data.tp.newtuple->tuple;
+#endif
+	}
+
+	if (change->action != REORDER_BUFFER_CHANGE_UPDATE || oldtuple == NULL || newtuple == NULL)
+		return (pg_shard_hash(entry, tupdesc, oldtuple != NULL ? oldtuple : newtuple) % data->shard_count) != (uint32) data->shard_id;
+
+	inold = (pg_shard_hash(entry, tupdesc, oldtuple) % data->shard_count) == (uint32) data->shard_id;
+	innew = (pg_shard_hash(entry, tupdesc, newtuple) % data->shard_count) == (uint32) data->shard_id;
+
+	if (inold && !innew)
+		*action = REORDER_BUFFER_CHANGE_DELETE;
+	else if (!inold && innew)
+		*action = REORDER_BUFFER_CHANGE_INSERT;
+
+	return !inold && !innew;
+}
+
+#if PG_VERSION_NUM >= 100000
+/* Look up publications by name. They are kept until a publication changes. */
+static void
+load_publications(JsonDecodingData *data)
+{
+	MemoryContext	old;
+	ListCell		*lc;
+
+	if (JsonPublicationsValid)
+		return;
+
+	MemoryContextReset(data->publication_context);
+	data->publications = NIL;
+
+	old = MemoryContextSwitchTo(data->publication_context);
+	foreach(lc, data->publication_names)
+	{
+		char	*pubname = (char *) lfirst(lc);
+
+		data->publications = lappend(data->publications, GetPublicationByName(pubname, false));
+	}
+	MemoryContextSwitchTo(old);
+
+	JsonPublicationsValid = true;
+}
+
+/*
+ * Is this relation published by any publication in publication-names? If so,
+ * pubactions is the union of the actions of these publications. A partition
+ * is published if one of its ancestors is (PostgreSQL 13 or later).
+ */
+static bool
+pg_publication_actions(JsonDecodingData *data, Relation relation, JsonAction *pubactions)
+{
+	Oid			relid = RelationGetRelid(relation);
+	List		*pubids;
+	List		*schemapubids = NIL;
+	ListCell	*lc;
+	bool		published = false;
+
+	load_publications(data);
+
+	pubids = GetRelationPublications(relid);
+#if PG_VERSION_NUM >= 150000
+	schemapubids = GetSchemaPublications(RelationGetNamespace(relation));
+#endif
+
+#if PG_VERSION_NUM >= 130000
+	if (relation->rd_rel->relispartition)
+	{
+		List	*ancestors = get_partition_ancestors(relid);
+
+		foreach(lc, ancestors)
+		{
+			Oid		ancestor = lfirst_oid(lc);
+
+			pubids = list_concat(pubids, GetRelationPublications(ancestor));
+#if PG_VERSION_NUM >= 150000
+			schemapubids = list_concat(schemapubids, GetSchemaPublications(get_rel_namespace(ancestor)));
+#endif
+		}
+	}
+#endif
+
+	memset(pubactions, 0, sizeof(JsonAction));
+
+	foreach(lc, data->publications)
+	{
+		Publication	*pub = (Publication *) lfirst(lc);
+
+		if (!pub->alltables &&
+			!list_member_oid(pubids, pub->oid) &&
+			!list_member_oid(schemapubids, pub->oid))
+			continue;
+
+		published = true;
+		pubactions->insert |= pub->pubactions.pubinsert;
+		pubactions->update |= pub->pubactions.pubupdate;
+		pubactions->delete |= pub->pubactions.pubdelete;
+#if PG_VERSION_NUM >= 110000
+		pubactions->truncate |= pub->pubactions.pubtruncate;
+#endif
+	}
+
+	return published;
+}
+
+/*
+ * Syscache invalidation callback for publications and their tables and
+ * schemas. Reload publications and rebuild all relations.
+ */
+static void
+publication_cache_cb(Datum arg, int cacheid, uint32 hashvalue)
+{
+	JsonPublicationsValid = false;
+	relation_cache_invalidate_cb(arg, InvalidOid);
+}
+#endif
+
+#if PG_VERSION_NUM >= 90500
+static bool
+pg_filter_by_origin(LogicalDecodingContext *ctx, RepOriginId origin_id)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+
+	elog(DEBUG3, "origin: %u", origin_id);
+
+	/* changes produced locally are never filtered */
+	if (origin_id == InvalidRepOriginId)
+		return false;
+
+	/* Filter origins, if available */
+	if (bms_is_member(origin_id, data->filter_origins_set))
+	{
+		elog(DEBUG2, "origin \"%u\" was filtered out", origin_id);
+		return true;
+	}
+
+	/*
+	 * There isn't a list of origins to filter or origin is not contained in
+	 * the filter list hence forward to all subscribers.
+	 */
+	return false;
+}
+#endif
+
+/* BEGIN callback */
+static void
+pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+	MemoryContext	old;
+
+	/* state of the previous transaction is gone */
+	MemoryContextReset(data->txn_context);
+	data->txn_fragment = NULL;
+	old = MemoryContextSwitchTo(data->txn_context);
+
+	if (data->format_version == 2)
+		pg_decode_begin_txn_v2(ctx, txn);
+	else if (data->format_version == 1)
+		pg_decode_begin_txn_v1(ctx, txn);
+	else
+		elog(ERROR, "format version %d is not supported", data->format_version);
+
+	MemoryContextSwitchTo(old);
+}
+
+static void
+pg_decode_begin_txn_v1(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+
+	data->nr_changes = 0;
+
+	/* Transaction starts */
+	OutputPluginPrepareWrite(ctx, true);
+
+	appendStringInfo(ctx->out, "{%s", data->nl);
+
+	if (data->include_xids)
+		appendStringInfo(ctx->out, "%s\"xid\":%s%u,%s", data->ht, data->sp, txn->xid, data->nl);
+
+	if (data->include_lsn)
+	{
+		appendStringInfo(ctx->out, "%s\"nextlsn\":%s", data->ht, data->sp);
+		pg_append_lsn(data, ctx->out, txn->end_lsn);
+		appendStringInfo(ctx->out, ",%s", data->nl);
+	}
+
+	if (data->include_timestamp)
+	{
+		appendStringInfo(ctx->out, "%s\"timestamp\":%s", data->ht, data->sp);
+#if PG_VERSION_NUM >= 150000
+		pg_append_timestamp(data, ctx->out, txn->xact_time.commit_time);
+#else
+		pg_append_timestamp(data, ctx->out, txn->commit_time);
+#endif
+		appendStringInfo(ctx->out, ",%s", data->nl);
+	}
+
+#if PG_VERSION_NUM >= 90500
+	if (data->include_origin)
+		appendStringInfo(ctx->out, "%s\"origin\":%s%u,%s", data->ht, data->sp, txn->origin_id, data->nl);
+#endif
+
+	appendStringInfo(ctx->out, "%s\"change\":%s[", data->ht, data->sp);
+
+	if (data->write_in_chunks)
+		OutputPluginWrite(ctx, true);
+}
+
+static void
+pg_decode_begin_txn_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+
+	/*
+	 * Buffered tuples must match the relation descriptor when they are
+	 * output at commit hence transactions with DDL are not compacted.
+	 */
+	if (data->compact_changes)
+	{
+		/* temporary file was closed at the end of the previous transaction */
+		data->compact_state->file = NULL;
+		compact_reset(data->compact_state);
+#if PG_VERSION_NUM >= 130000
+		data->compact_state->active = !rbtxn_has_catalog_changes(txn);
+#else
+		data->compact_state->active = !txn->has_catalog_changes;
+#endif
+	}
+
+	/* summary replaces BEGIN and COMMIT objects */
+	if (data->summary)
+	{
+		MemoryContextReset(data->summary_state->context);
+		data->summary_state->hash = NULL;
+		data->summary_state->tables = NIL;
+		return;
+	}
+
+	/* don't include BEGIN object */
+	if (!data->include_transaction)
+		return;
+
+	OutputPluginPrepareWrite(ctx, true);
+	appendStringInfoString(ctx->out, "{\"action\":\"B\"");
+	pg_append_txn_fragment(ctx, txn);
+
+	if (data->include_lsn)
+	{
+		appendStringInfoString(ctx->out, ",\"lsn\":");
+		pg_append_lsn(data, ctx->out, txn->final_lsn);
+
+		appendStringInfoString(ctx->out, ",\"nextlsn\":");
+		pg_append_lsn(data, ctx->out, txn->end_lsn);
+	}
+
+	appendStringInfoChar(ctx->out, '}');
+	OutputPluginWrite(ctx, true);
+}
+
+/* COMMIT callback */
+static void
+pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					 XLogRecPtr commit_lsn)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+	MemoryContext	old;
+
+	/*
+	 * Some older minor versions from back branches (10 to 14) calls
+	 * OutputPluginUpdateProgress(). That's before the fix
+	 * f95d53eded55ecbf037f6416ced6af29a2c3caca. After that,
+	 * update_replication_progress() function is used for back branches. In
+	 * version 15, update_replication_progress() changes the signature to
+	 * support skipped transactions. In version 16,
+	 * OutputPluginUpdateProgress() is back because a proper fix was added into
+	 * logical decoding.
+	 */
+#if PG_VERSION_NUM >= 160000
+	OutputPluginUpdateProgress(ctx, false);		/* XXX change 2nd param when skipped empty transaction is supported */
+#elif PG_VERSION_NUM >= 150000 && PG_VERSION_NUM < 160000
+	update_replication_progress(ctx, false);	/* XXX change 2nd param when skipped empty transaction is supported */
+#elif PG_VERSION_NUM >= 140004 && PG_VERSION_NUM < 150000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 130008 && PG_VERSION_NUM < 140000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 120012 && PG_VERSION_NUM < 130000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 110017 && PG_VERSION_NUM < 120000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 100022 && PG_VERSION_NUM < 110000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 140000 && PG_VERSION_NUM < 140004
+	OutputPluginUpdateProgress(ctx);
+#elif PG_VERSION_NUM >= 130000 && PG_VERSION_NUM < 130008
+	OutputPluginUpdateProgress(ctx);
+#elif PG_VERSION_NUM >= 120000 && PG_VERSION_NUM < 120012
+	OutputPluginUpdateProgress(ctx);
+#elif PG_VERSION_NUM >= 110000 && PG_VERSION_NUM < 110017
+	OutputPluginUpdateProgress(ctx);
+#elif PG_VERSION_NUM >= 100000 && PG_VERSION_NUM < 100022
+	OutputPluginUpdateProgress(ctx);
+#endif
+
+	elog(DEBUG2, "my change counter: " UINT64_FORMAT " ; # of changes: " UINT64_FORMAT " ; # of changes in memory: " UINT64_FORMAT, data->nr_changes, txn->nentries, txn->nentries_mem);
+	elog(DEBUG2, "# of subxacts: %d", txn->nsubtxns);
+
+	old = MemoryContextSwitchTo(data->txn_context);
+
+	if (data->format_version == 2)
+		pg_decode_commit_txn_v2(ctx, txn, commit_lsn);
+	else if (data->format_version == 1)
+		pg_decode_commit_txn_v1(ctx, txn, commit_lsn);
+	else
+		elog(ERROR, "format version %d is not supported", data->format_version);
+
+	MemoryContextSwitchTo(old);
+
+#if PG_VERSION_NUM >= 130000
+	elog(DEBUG2, "memory used by transaction: %zu bytes", MemoryContextMemAllocated(data->txn_context, true));
+#endif
+	MemoryContextReset(data->txn_context);
+	data->txn_fragment = NULL;
+}
+
+static void
+pg_decode_commit_txn_v1(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					 XLogRecPtr commit_lsn)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+
+	/* Transaction ends */
+	if (data->write_in_chunks)
+		OutputPluginPrepareWrite(ctx, true);
+
+	/* if we don't write in chunks, we need a newline here */
+	if (!data->write_in_chunks)
+		appendStringInfo(ctx->out, "%s", data->nl);
+
+	appendStringInfo(ctx->out, "%s]%s}", data->ht, data->nl);
+
+	OutputPluginWrite(ctx, true);
+}
+
+static void
+pg_decode_commit_txn_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+					 XLogRecPtr commit_lsn)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+
+	/* output net changes */
+	if (data->compact_changes && data->compact_state->active)
+	{
+		pg_compact_flush(ctx, txn);
+		data->compact_state->active = false;
+	}
+
+	if (data->summary)
+	{
+		pg_decode_write_summary(ctx, txn, commit_lsn);
+		return;
+	}
+
+	/* don't include COMMIT object */
+	if (!data->include_transaction)
+		return;
+
+	OutputPluginPrepareWrite(ctx, true);
+	appendStringInfoString(ctx->out, "{\"action\":\"C\"");
+	pg_append_txn_fragment(ctx, txn);
+
+	if (data->include_lsn)
+	{
+		appendStringInfoString(ctx->out, ",\"lsn\":");
+		pg_append_lsn(data, ctx->out, commit_lsn);
+
+		appendStringInfoString(ctx->out, ",\"nextlsn\":");
+		pg_append_lsn(data, ctx->out, txn->end_lsn);
+	}
+
+	appendStringInfoChar(ctx->out, '}');
+	OutputPluginWrite(ctx, true);
+}
+
+/* Open an array of tuple information */
+static void
+pg_v1_open_array(JsonDecodingData *data, StringInfo out, bool replident, const char *name)
+{
+	appendStringInfoString(out, data->ht);
+	appendStringInfoString(out, data->ht);
+	appendStringInfoString(out, data->ht);
+	if (replident)
+		appendStringInfoString(out, data->ht);
+	appendStringInfoChar(out, '"');
+	appendStringInfoString(out, name);
+	appendStringInfoString(out, "\":");
+	appendStringInfoString(out, data->sp);
+	appendStringInfoChar(out, '[');
+}
+
+/* Close an array of tuple information */
+static void
+pg_v1_close_array(JsonDecodingData *data, StringInfo out, bool addcomma)
+{
+	if (addcomma)
+		appendStringInfoString(out, "],");
+	else
+		appendStringInfoChar(out, ']');
+	appendStringInfoString(out, data->nl);
+}
+
+/* Separate array elements */
+static void
+pg_v1_separator(JsonDecodingData *data, StringInfo out, bool *first)
+{
+	if (*first)
+		*first = false;
+	else
+	{
+		appendStringInfoChar(out, ',');
+		appendStringInfoString(out, data->sp);
+	}
+}
+
+/*
+ * Write tuple information. Each array is written straight into the output
+ * using the column plan; the tuple is broken down only once.
+ *
+ * keys: only replica identity columns?
+ * replident: is this tuple a replica identity?
+ */
+static void
+tuple_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, JsonTuple *jt, bool keys, bool replident, bool addcomma, Relation relation)
+{
+	JsonDecodingData	*data;
+	JsonRelationEntry	*entry;
+	StringInfo			out = ctx->out;
+	bool				*skip;
+	bool				first;
+	int					i;
+
+	data = ctx->output_plugin_private;
+
+	entry = get_column_plan(data, relation);
+
+	pg_json_tuple_fetch(jt, tupdesc, entry, keys, true);
+
+	skip = (bool *) palloc(Max(entry->ncolumns, 1) * sizeof(bool));
+
+	for (i = 0; i < entry->ncolumns; i++)
+	{
+		JsonColumn	*col = &entry->columns[i];
+		int			j = col->attidx;
+
+		/* Replica identity column? */
+		if (keys && !col->identity)
+			skip[i] = true;
+		/* Skip nulls iif printing key/identity */
+		else if (jt->nulls[j])
+			skip[i] = replident;
+		/* XXX Unchanged TOAST Datum does not need to be output */
+		else if (col->isvarlena && VARATT_IS_EXTERNAL_ONDISK(jt->values[j]))
+		{
+			elog(DEBUG1, "column %s has an unchanged TOAST", col->name);
+			skip[i] = true;
+		}
+		else
+			skip[i] = false;
+	}
+
+	/*
+	 * If replident is true, it will output info about replica identity. In this
+	 * case, there are special JSON objects for it. Otherwise, it will print new
+	 * tuple data.
+	 */
+	if (replident)
+	{
+		appendStringInfoString(out, data->ht);
+		appendStringInfoString(out, data->ht);
+		appendStringInfoString(out, data->ht);
+		appendStringInfoString(out, "\"oldkeys\":");
+		appendStringInfoString(out, data->sp);
+		appendStringInfoChar(out, '{');
+		appendStringInfoString(out, data->nl);
+	}
+
+	pg_v1_open_array(data, out, replident, replident ? "keynames" : "columnnames");
+	for (i = 0, first = true; i < entry->ncolumns; i++)
+	{
+		if (skip[i])
+			continue;
+		pg_v1_separator(data, out, &first);
+		appendStringInfoString(out, entry->columns[i].name);
+	}
+	pg_v1_close_array(data, out, true);
+
+	if (data->include_types)
+	{
+		pg_v1_open_array(data, out, replident, replident ? "keytypes" : "columntypes");
+		for (i = 0, first = true; i < entry->ncolumns; i++)
+		{
+			if (skip[i])
+				continue;
+			pg_v1_separator(data, out, &first);
+			appendStringInfoString(out, entry->columns[i].type);
+		}
+		pg_v1_close_array(data, out, true);
+	}
+
+	if (data->include_type_oids)
+	{
+		pg_v1_open_array(data, out, replident, replident ? "keytypeoids" : "columntypeoids");
+		for (i = 0, first = true; i < entry->ncolumns; i++)
+		{
+			if (skip[i])
+				continue;
+			pg_v1_separator(data, out, &first);
+			appendStringInfoString(out, entry->columns[i].typeoid);
+		}
+		pg_v1_close_array(data, out, true);
+	}
+
+	if (!replident && data->include_column_positions)
+	{
+		pg_v1_open_array(data, out, false, "columnpositions");
+		for (i = 0, first = true; i < entry->ncolumns; i++)
+		{
+			if (skip[i])
+				continue;
+			pg_v1_separator(data, out, &first);
+			appendStringInfoString(out, entry->columns[i].position);
+		}
+		pg_v1_close_array(data, out, true);
+	}
+
+	/* not-null constraints are printed only with types */
+	if (!replident && data->include_not_null)
+	{
+		pg_v1_open_array(data, out, false, "columnoptionals");
+		for (i = 0, first = true; i < entry->ncolumns && data->include_types; i++)
+		{
+			if (skip[i])
+				continue;
+			pg_v1_separator(data, out, &first);
+			appendStringInfoString(out, entry->columns[i].notnull ? "false" : "true");
+		}
+		pg_v1_close_array(data, out, true);
+	}
+
+	if (!replident && data->include_default)
+	{
+		pg_v1_open_array(data, out, false, "columndefaults");
+		for (i = 0, first = true; i < entry->ncolumns; i++)
+		{
+			if (skip[i])
+				continue;
+			if (entry->columns[i].defval == NULL)
+			{
+				first = false;
+				continue;
+			}
+			pg_v1_separator(data, out, &first);
+			appendStringInfoString(out, entry->columns[i].defval);
+		}
+		pg_v1_close_array(data, out, true);
+	}
+
+	pg_v1_open_array(data, out, replident, replident ? "keyvalues" : "columnvalues");
+	for (i = 0, first = true; i < entry->ncolumns; i++)
+	{
+		if (skip[i])
+			continue;
+		pg_v1_separator(data, out, &first);
+		pg_json_tuple_write_value(ctx, jt, &entry->columns[i], replident);
+	}
+
+	/* Column info ends */
+	if (replident)
+	{
+		pg_v1_close_array(data, out, false);
+		appendStringInfoString(out, data->ht);
+		appendStringInfoString(out, data->ht);
+		appendStringInfoString(out, data->ht);
+		appendStringInfoChar(out, '}');
+		appendStringInfoString(out, data->nl);
+	}
+	else
+		pg_v1_close_array(data, out, addcomma);
+
+	pfree(skip);
+}
+
+/* Print columns information */
+static void
+columns_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, JsonTuple *jt, bool addcomma, Relation relation)
+{
+	tuple_to_stringinfo(ctx, tupdesc, jt, false, false, addcomma, relation);
+}
+
+/* Print replica identity information */
+static void
+identity_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, JsonTuple *jt, bool keys, Relation relation)
+{
+	/* addcomma does not matter */
+	tuple_to_stringinfo(ctx, tupdesc, jt, keys, true, false, relation);
+}
+
+/*
+ * Print primary key information. Names and types come from the column plan
+ * hence nothing is looked up per change.
+ */
+static void
+pk_to_stringinfo(LogicalDecodingContext *ctx, Relation relation, bool addcomma)
+{
+	JsonDecodingData	*data;
+	JsonRelationEntry	*entry;
+	StringInfo			out = ctx->out;
+	bool				first;
+	int					i;
+
+	data = ctx->output_plugin_private;
+
+	entry = get_column_plan(data, relation);
+
+	appendStringInfoString(out, data->ht);
+	appendStringInfoString(out, data->ht);
+	appendStringInfoString(out, data->ht);
+	appendStringInfoString(out, "\"pk\":");
+	appendStringInfoString(out, data->sp);
+	appendStringInfoChar(out, '{');
+	appendStringInfoString(out, data->nl);
+
+	pg_v1_open_array(data, out, true, "pknames");
+	for (i = 0, first = true; i < entry->ncolumns; i++)
+	{
+		if (!entry->columns[i].pk)
+			continue;
+		pg_v1_separator(data, out, &first);
+		appendStringInfoString(out, entry->columns[i].name);
+	}
+	pg_v1_close_array(data, out, true);
+
+	/* types are only in the column plan with include-types */
+	pg_v1_open_array(data, out, true, "pktypes");
+	for (i = 0, first = true; i < entry->ncolumns && data->include_types; i++)
+	{
+		if (!entry->columns[i].pk)
+			continue;
+		pg_v1_separator(data, out, &first);
+		appendStringInfoString(out, entry->columns[i].type);
+	}
+	pg_v1_close_array(data, out, false);
+
+	appendStringInfoString(out, data->ht);
+	appendStringInfoString(out, data->ht);
+	appendStringInfoString(out, data->ht);
+	appendStringInfoChar(out, '}');
+	if (addcomma)
+		appendStringInfoChar(out, ',');
+	appendStringInfoString(out, data->nl);
+}
+
+/*
+ * Append an LSN as a JSON value. It is an integer (numeric-lsn) or a string
+ * in the same format as pg_lsn_out(), written without allocating.
+ */
+static void
+pg_append_lsn(JsonDecodingData *data, StringInfo buf, XLogRecPtr lsn)
+{
+	static const char hexdigits[] = "0123456789ABCDEF";
+	char		str[19];		/* "8/8" */
+	char	   *p = str + sizeof(str);
+	uint32		lo = (uint32) lsn;
+	uint32		hi = (uint32) (lsn >> 32);
+
+	if (data->numeric_lsn)
+	{
+		appendStringInfo(buf, UINT64_FORMAT, (uint64) lsn);
+		return;
+	}
+
+	/* digits are produced backwards */
+	*--p = '"';
+	do
+	{
+		*--p = hexdigits[lo & 0xF];
+		lo >>= 4;
+	} while (lo != 0);
+	*--p = '/';
+	do
+	{
+		*--p = hexdigits[hi & 0xF];
+		hi >>= 4;
+	} while (hi != 0);
+	*--p = '"';
+
+	appendBinaryStringInfo(buf, p, str + sizeof(str) - p);
+}
+
+/* Microseconds since the Unix epoch */
+static int64
+pg_timestamp_to_epoch(TimestampTz ts)
+{
+#if PG_VERSION_NUM < 100000 && !defined(HAVE_INT64_TIMESTAMP)
+	return (int64) rint((ts + (double) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * SECS_PER_DAY) * USECS_PER_SEC);
+#else
+	return ts + (int64) (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE) * USECS_PER_DAY;
+#endif
+}
+
+/* Append a commit timestamp as a JSON value */
+static void
+pg_append_timestamp(JsonDecodingData *data, StringInfo buf, TimestampTz ts)
+{
+	if (data->epoch_timestamp)
+		appendStringInfo(buf, INT64_FORMAT, pg_timestamp_to_epoch(ts));
+	else
+		appendStringInfo(buf, "\"%s\"", timestamptz_to_str(ts));
+}
+
+/*
+ * Append a timestamp (microseconds), date (days) or time (microseconds since
+ * midnight) column value as an integer relative to the Unix epoch. Returns
+ * false for infinite values.
+ */
+static bool
+pg_append_epoch(StringInfo buf, JsonValueKind kind, Datum value)
+{
+	int64		epoch;
+
+	switch (kind)
+	{
+		case JSON_VALUE_TIMESTAMP:
+		case JSON_VALUE_TIMESTAMPTZ:
+			{
+				Timestamp	ts = DatumGetTimestamp(value);
+
+				if (TIMESTAMP_NOT_FINITE(ts))
+					return false;
+				epoch = pg_timestamp_to_epoch(ts);
+			}
+			break;
+		case JSON_VALUE_DATE:
+			{
+				DateADT		d = DatumGetDateADT(value);
+
+				if (DATE_NOT_FINITE(d))
+					return false;
+				epoch = (int64) d + (POSTGRES_EPOCH_JDATE - UNIX_EPOCH_JDATE);
+			}
+			break;
+		case JSON_VALUE_TIME:
+#if PG_VERSION_NUM < 100000 && !defined(HAVE_INT64_TIMESTAMP)
+			epoch = (int64) rint(DatumGetTimeADT(value) * USECS_PER_SEC);
+#else
+			epoch = DatumGetTimeADT(value);
+#endif
+			break;
+		default:
+			return false;
+	}
+
+	appendStringInfo(buf, INT64_FORMAT, epoch);
+	return true;
+}
+
+/*
+ * Write values of a few common types without calling their output functions.
+ * The text is the same as the output function's in DateStyle ISO and the
+ * current TimeZone. Returns false if the output function should be used
+ * (other DateStyle, infinite values or options that are not set). Varlena
+ * values are already detoasted.
+ */
+static bool
+pg_encode_builtin(JsonDecodingData *data, StringInfo buf, Oid typid, JsonValueKind kind, Datum value)
+{
+	switch (kind)
+	{
+		case JSON_VALUE_ARRAY:
+			if (!data->structured_types)
+				return false;
+			pg_append_array(data, buf, DatumGetArrayTypeP(value));
+			return true;
+		case JSON_VALUE_COMPOSITE:
+			if (!data->structured_types)
+				return false;
+			pg_append_composite(data, buf, DatumGetHeapTupleHeader(value));
+			return true;
+		case JSON_VALUE_RANGE:
+			if (!data->structured_types)
+				return false;
+			pg_append_range(data, buf, value);
+			return true;
+		case JSON_VALUE_HSTORE:
+			if (!data->structured_types)
+				return false;
+			pg_append_encoded(buf, get_type_entry(data, typid)->encoder, value);
+			return true;
+		case JSON_VALUE_CUSTOM:
+			pg_append_encoded(buf, get_type_entry(data, typid)->encoder, value);
+			return true;
+		case JSON_VALUE_UUID:
+			pg_append_uuid(buf, DatumGetUUIDP(value));
+			return true;
+		case JSON_VALUE_ENUM:
+			pg_append_enum(data, buf, DatumGetObjectId(value));
+			return true;
+		case JSON_VALUE_JSON:
+			if (!data->embed_json)
+				return false;
+			pg_append_json(buf, VARDATA_ANY(DatumGetPointer(value)), VARSIZE_ANY_EXHDR(DatumGetPointer(value)));
+			return true;
+		case JSON_VALUE_JSONB:
+			if (!data->embed_json)
+				return false;
+#if PG_VERSION_NUM >= 110000
+			pg_append_jsonb(buf, &DatumGetJsonbP(value)->root);
+#else
+			pg_append_jsonb(buf, &DatumGetJsonb(value)->root);
+#endif
+			return true;
+		case JSON_VALUE_DATE:
+			if (data->epoch_temporal)
+				return pg_append_epoch(buf, kind, value);
+			return pg_append_iso_date(buf, DatumGetDateADT(value));
+		case JSON_VALUE_TIMESTAMP:
+			if (data->epoch_temporal)
+				return pg_append_epoch(buf, kind, value);
+			return pg_append_iso_timestamp(buf, DatumGetTimestamp(value), false, false);
+		case JSON_VALUE_TIMESTAMPTZ:
+			if (data->epoch_temporal)
+				return pg_append_epoch(buf, kind, value);
+			return pg_append_iso_timestamp(buf, DatumGetTimestampTz(value), true, data->utc_timestamptz);
+		case JSON_VALUE_TIME:
+			if (data->epoch_temporal)
+				return pg_append_epoch(buf, kind, value);
+			return false;
+		default:
+			return false;
+	}
+}
+
+/*
+ * Write the result of a type encoder. json is copied as is, text is a JSON
+ * string and bytea is a hex string as bytea columns are.
+ */
+static void
+pg_append_encoded(StringInfo buf, JsonTypeEncoder *encoder, Datum value)
+{
+	static const char hextbl[] = "0123456789abcdef";
+#if PG_VERSION_NUM >= 120000
+	LOCAL_FCINFO(fcinfo, 1);
+#else
+	FunctionCallInfoData fcinfodata;
+	FunctionCallInfo fcinfo = &fcinfodata;
+#endif
+	Datum		result;
+	char		*p;
+	int			len;
+	int			i;
+
+	/* FunctionCall1() does not accept a null result */
+	InitFunctionCallInfoData(*fcinfo, &encoder->flinfo, 1, InvalidOid, NULL, NULL);
+#if PG_VERSION_NUM >= 120000
+	fcinfo->args[0].value = value;
+	fcinfo->args[0].isnull = false;
+#else
+	fcinfo->arg[0] = value;
+	fcinfo->argnull[0] = false;
+#endif
+	result = FunctionCallInvoke(fcinfo);
+	if (fcinfo->isnull)
+	{
+		appendStringInfoString(buf, "null");
+		return;
+	}
+
+	if (encoder->rettype == JSONBOID)
+	{
+#if PG_VERSION_NUM >= 110000
+		pg_append_jsonb(buf, &DatumGetJsonbP(result)->root);
+#else
+		pg_append_jsonb(buf, &DatumGetJsonb(result)->root);
+#endif
+		return;
+	}
+
+	result = PointerGetDatum(PG_DETOAST_DATUM_PACKED(result));
+	p = VARDATA_ANY(DatumGetPointer(result));
+	len = VARSIZE_ANY_EXHDR(DatumGetPointer(result));
+
+	switch (encoder->rettype)
+	{
+		case JSONOID:
+			pg_append_json(buf, p, len);
+			break;
+		case TEXTOID:
+			pg_escape_json_len(buf, p, len);
+			break;
+		case BYTEAOID:
+			enlargeStringInfo(buf, len * 2 + 2);
+			buf->data[buf->len++] = '"';
+			for (i = 0; i < len; i++)
+			{
+				buf->data[buf->len++] = hextbl[((unsigned char) p[i]) >> 4];
+				buf->data[buf->len++] = hextbl[((unsigned char) p[i]) & 0x0f];
+			}
+			buf->data[buf->len++] = '"';
+			buf->data[buf->len] = '\0';
+			break;
+	}
+}
+
+/*
+ * Write an array element, a composite attribute or a range bound. The type
+ * cache is used because these types are not in the column plan.
+ */
+static void
+pg_encode_nested(JsonDecodingData *data, StringInfo buf, Oid typid, Datum value, bool isnull)
+{
+	JsonTypeEntry	*entry;
+
+	if (isnull)
+	{
+		appendStringInfoString(buf, "null");
+		return;
+	}
+
+	entry = get_type_entry(data, typid);
+	pg_encode_value(data, buf, typid, entry->kind, &entry->outfunc, entry->isvarlena, value);
+}
+
+/*
+ * Write an array as nested JSON arrays, one level per dimension. Lower
+ * bounds are not kept.
+ */
+static void
+pg_append_array(JsonDecodingData *data, StringInfo buf, ArrayType *array)
+{
+	JsonTypeEntry	*elem;
+	Datum			*values;
+	bool			*nulls;
+	int				nitems;
+	int				i = 0;
+
+	if (ARR_NDIM(array) == 0)
+	{
+		appendStringInfoString(buf, "[]");
+		return;
+	}
+
+	elem = get_type_entry(data, ARR_ELEMTYPE(array));
+	deconstruct_array(array, ARR_ELEMTYPE(array), elem->typlen, elem->typbyval,
+					  elem->typalign, &values, &nulls, &nitems);
+
+	pg_append_array_dim(data, buf, ARR_ELEMTYPE(array), 0, ARR_NDIM(array),
+						ARR_DIMS(array), values, nulls, &i);
+
+	pfree(values);
+	pfree(nulls);
+}
+
+static void
+pg_append_array_dim(JsonDecodingData *data, StringInfo buf, Oid elemtype, int dim, int ndim, int *dims, Datum *values, bool *nulls, int *i)
+{
+	int		j;
+
+	appendStringInfoCharMacro(buf, '[');
+	for (j = 0; j < dims[dim]; j++)
+	{
+		if (j > 0)
+			appendStringInfoCharMacro(buf, ',');
+
+		if (dim + 1 < ndim)
+			pg_append_array_dim(data, buf, elemtype, dim + 1, ndim, dims, values, nulls, i);
+		else
+		{
+			pg_encode_nested(data, buf, elemtype, values[*i], nulls[*i]);
+			(*i)++;
+		}
+	}
+	appendStringInfoCharMacro(buf, ']');
+}
+
+/* Write a composite value as an object keyed by attribute name */
+static void
+pg_append_composite(JsonDecodingData *data, StringInfo buf, HeapTupleHeader td)
+{
+	TupleDesc		tupdesc;
+	HeapTupleData	tuple;
+	Datum			*values;
+	bool			*nulls;
+	bool			first = true;
+	int				i;
+
+	tupdesc = lookup_rowtype_tupdesc(HeapTupleHeaderGetTypeId(td),
+									 HeapTupleHeaderGetTypMod(td));
+
+	tuple.t_len = HeapTupleHeaderGetDatumLength(td);
+	ItemPointerSetInvalid(&(tuple.t_self));
+	tuple.t_tableOid = InvalidOid;
+	tuple.t_data = td;
+
+	values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+	nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+	heap_deform_tuple(&tuple, tupdesc, values, nulls);
+
+	appendStringInfoCharMacro(buf, '{');
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		Form_pg_attribute	attr;
+
+#if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
+		attr = tupdesc->attrs[i];
+#else
+		attr = TupleDescAttr(tupdesc, i);
+#endif
+
+		if (attr->attisdropped)
+			continue;
+
+		if (!first)
+			appendStringInfoCharMacro(buf, ',');
+		first = false;
+
+		pg_escape_json(buf, NameStr(attr->attname));
+		appendStringInfoCharMacro(buf, ':');
+		pg_encode_nested(data, buf, attr->atttypid, values[i], nulls[i]);
+	}
+	appendStringInfoCharMacro(buf, '}');
+
+	ReleaseTupleDesc(tupdesc);
+
+	pfree(values);
+	pfree(nulls);
+}
+
+/*
+ * Write a range as an object with its bounds. Infinite bounds are null and
+ * an empty range is {"empty":true}.
+ */
+static void
+pg_append_range(JsonDecodingData *data, StringInfo buf, Datum value)
+{
+	RangeType		*range;
+	TypeCacheEntry	*typcache;
+	RangeBound		lower;
+	RangeBound		upper;
+	bool			empty;
+
+#if PG_VERSION_NUM >= 110000
+	range = DatumGetRangeTypeP(value);
+#else
+	range = DatumGetRangeType(value);
+#endif
+	typcache = lookup_type_cache(RangeTypeGetOid(range), TYPECACHE_RANGE_INFO);
+	range_deserialize(typcache, range, &lower, &upper, &empty);
+
+	if (empty)
+	{
+		appendStringInfoString(buf, "{\"empty\":true}");
+		return;
+	}
+
+	appendStringInfoString(buf, "{\"lower\":");
+	pg_encode_nested(data, buf, typcache->rngelemtype->type_id, lower.val, lower.infinite);
+	appendStringInfoString(buf, ",\"upper\":");
+	pg_encode_nested(data, buf, typcache->rngelemtype->type_id, upper.val, upper.infinite);
+	appendStringInfo(buf, ",\"lower_inc\":%s,\"upper_inc\":%s}",
+					 lower.inclusive ? "true" : "false",
+					 upper.inclusive ? "true" : "false");
+}
+
+/*
+ * Write a jsonb container as compact JSON, straight from its binary form
+ * instead of formatting it with jsonb_out() and then escaping the result.
+ */
+static void
+pg_append_jsonb(StringInfo buf, JsonbContainer *container)
+{
+	JsonbIterator	*it;
+	JsonbValue		v;
+	int				r;
+	bool			first = true;
+	bool			raw = false;
+
+	it = JsonbIteratorInit(container);
+	while ((r = JsonbIteratorNext(&it, &v, false)) != WJB_DONE)
+	{
+		switch (r)
+		{
+			case WJB_BEGIN_ARRAY:
+				/* a scalar is stored as a one-element array */
+				if (v.val.array.rawScalar)
+				{
+					raw = true;
+					break;
+				}
+				if (!first)
+					appendStringInfoCharMacro(buf, ',');
+				appendStringInfoCharMacro(buf, '[');
+				first = true;
+				break;
+			case WJB_BEGIN_OBJECT:
+				if (!first)
+					appendStringInfoCharMacro(buf, ',');
+				appendStringInfoCharMacro(buf, '{');
+				first = true;
+				break;
+			case WJB_KEY:
+				if (!first)
+					appendStringInfoCharMacro(buf, ',');
+				pg_escape_json_len(buf, v.val.string.val, v.val.string.len);
+				appendStringInfoCharMacro(buf, ':');
+				/* value follows without separator */
+				first = true;
+				break;
+			case WJB_VALUE:
+			case WJB_ELEM:
+				if (!first)
+					appendStringInfoCharMacro(buf, ',');
+				pg_append_jsonb_scalar(buf, &v);
+				first = false;
+				break;
+			case WJB_END_ARRAY:
+				if (!raw)
+					appendStringInfoCharMacro(buf, ']');
+				first = false;
+				break;
+			case WJB_END_OBJECT:
+				appendStringInfoCharMacro(buf, '}');
+				first = false;
+				break;
+			default:
+				elog(ERROR, "unexpected jsonb token: %d", (int) r);
+		}
+	}
+}
+
+/*
+ * Copy json text without the whitespace between tokens. json input is already
+ * validated hence only strings have to be recognized; whitespace inside them
+ * is escaped except for spaces.
+ */
+static void
+pg_append_json(StringInfo buf, const char *p, int len)
+{
+	const char	*end = p + len;
+	bool		instring = false;
+
+	enlargeStringInfo(buf, len);
+
+	for (; p < end; p++)
+	{
+		if (instring)
+		{
+			if (*p == '\\')
+				buf->data[buf->len++] = *p++;
+			else if (*p == '"')
+				instring = false;
+		}
+		else if (*p == '"')
+			instring = true;
+		else if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+			continue;
+
+		buf->data[buf->len++] = *p;
+	}
+	buf->data[buf->len] = '\0';
+}
+
+static void
+pg_append_jsonb_scalar(StringInfo buf, JsonbValue *v)
+{
+	char	*str;
+
+	switch (v->type)
+	{
+		case jbvNull:
+			appendStringInfoString(buf, "null");
+			break;
+		case jbvString:
+			pg_escape_json_len(buf, v->val.string.val, v->val.string.len);
+			break;
+		case jbvNumeric:
+			str = DatumGetCString(DirectFunctionCall1(numeric_out, NumericGetDatum(v->val.numeric)));
+			appendStringInfoString(buf, str);
+			pfree(str);
+			break;
+		case jbvBool:
+			if (v->val.boolean)
+				appendStringInfoString(buf, "true");
+			else
+				appendStringInfoString(buf, "false");
+			break;
+		default:
+			elog(ERROR, "unexpected jsonb value type: %d", (int) v->type);
+	}
+}
+
+/* Write value in decimal, zero padded to width */
+static char *
+pg_put_digits(char *p, int value, int width)
+{
+	char		tmp[12];
+	int			n = 0;
+
+	do
+	{
+		tmp[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	while (n < width)
+		tmp[n++] = '0';
+	while (n > 0)
+		*p++ = tmp[--n];
+
+	return p;
+}
+
+static char *
+pg_put_bc(char *p)
+{
+	memcpy(p, " BC", 3);
+	return p + 3;
+}
+
+/* date_out() in DateStyle ISO */
+static bool
+pg_append_iso_date(StringInfo buf, DateADT date)
+{
+	char		str[32];
+	char	   *p = str;
+	int			year,
+				month,
+				day;
+
+	if (DateStyle != USE_ISO_DATES || DATE_NOT_FINITE(date))
+		return false;
+
+	j2date(date + POSTGRES_EPOCH_JDATE, &year, &month, &day);
+
+	*p++ = '"';
+	p = pg_put_digits(p, (year > 0) ? year : -(year - 1), 4);
+	*p++ = '-';
+	p = pg_put_digits(p, month, 2);
+	*p++ = '-';
+	p = pg_put_digits(p, day, 2);
+	if (year <= 0)
+		p = pg_put_bc(p);
+	*p++ = '"';
+
+	appendBinaryStringInfo(buf, str, p - str);
+	return true;
+}
+
+/*
+ * timestamp_out() and timestamptz_out() in DateStyle ISO. If utc is true,
+ * timestamptz is written in UTC regardless of DateStyle and TimeZone.
+ */
+static bool
+pg_append_iso_timestamp(StringInfo buf, TimestampTz ts, bool withtz, bool utc)
+{
+#if PG_VERSION_NUM < 100000 && !defined(HAVE_INT64_TIMESTAMP)
+	return false;
+#else
+	struct pg_tm tm;
+	fsec_t		fsec;
+	int			tz = 0;
+	char		str[64];
+	char	   *p = str;
+
+	if ((DateStyle != USE_ISO_DATES && !utc) || TIMESTAMP_NOT_FINITE(ts))
+		return false;
+
+	/* without tz, fields are not converted to the session time zone */
+	if (timestamp2tm(ts, (withtz && !utc) ? &tz : NULL, &tm, &fsec, NULL, NULL) != 0)
+		return false;
+
+	*p++ = '"';
+	p = pg_put_digits(p, (tm.tm_year > 0) ? tm.tm_year : -(tm.tm_year - 1), 4);
+	*p++ = '-';
+	p = pg_put_digits(p, tm.tm_mon, 2);
+	*p++ = '-';
+	p = pg_put_digits(p, tm.tm_mday, 2);
+	*p++ = ' ';
+	p = pg_put_digits(p, tm.tm_hour, 2);
+	*p++ = ':';
+	p = pg_put_digits(p, tm.tm_min, 2);
+	*p++ = ':';
+	p = pg_put_digits(p, tm.tm_sec, 2);
+
+	/* fractional seconds without trailing zeros */
+	if (fsec != 0)
+	{
+		int		width = 6;
+
+		while (fsec % 10 == 0)
+		{
+			fsec /= 10;
+			width--;
+		}
+		*p++ = '.';
+		p = pg_put_digits(p, fsec, width);
+	}
+
+	/* same as EncodeTimezone(); tz is seconds west of UTC */
+	if (withtz)
+	{
+		int		sec = Abs(tz);
+		int		min = sec / SECS_PER_MINUTE;
+		int		hour;
+
+		sec -= min * SECS_PER_MINUTE;
+		hour = min / MINS_PER_HOUR;
+		min -= hour * MINS_PER_HOUR;
+
+		*p++ = (tz <= 0) ? '+' : '-';
+		p = pg_put_digits(p, hour, 2);
+		if (min != 0 || sec != 0)
+		{
+			*p++ = ':';
+			p = pg_put_digits(p, min, 2);
+		}
+		if (sec != 0)
+		{
+			*p++ = ':';
+			p = pg_put_digits(p, sec, 2);
+		}
+	}
+	if (tm.tm_year <= 0)
+		p = pg_put_bc(p);
+	*p++ = '"';
+
+	appendBinaryStringInfo(buf, str, p - str);
+	return true;
+#endif
+}
+
+/* uuid_out() */
+static void
+pg_append_uuid(StringInfo buf, pg_uuid_t *uuid)
+{
+	static const char hexdigits[] = "0123456789abcdef";
+	char		str[UUID_LEN * 2 + 6];
+	char	   *p = str;
+	int			i;
+
+	*p++ = '"';
+	for (i = 0; i < UUID_LEN; i++)
+	{
+		if (i == 4 || i == 6 || i == 8 || i == 10)
+			*p++ = '-';
+		*p++ = hexdigits[uuid->data[i] >> 4];
+		*p++ = hexdigits[uuid->data[i] & 0xF];
+	}
+	*p++ = '"';
+
+	appendBinaryStringInfo(buf, str, p - str);
+}
+
+/*
+ * enum_out(). Labels are looked up once and kept escaped until pg_enum
+ * changes.
+ */
+static void
+pg_append_enum(JsonDecodingData *data, StringInfo buf, Oid enumoid)
+{
+	JsonEnumEntry	*entry;
+
+	Assert(JsonEnumCache != NULL);
+
+	entry = (JsonEnumEntry *) hash_search(JsonEnumCache, (void *) &enumoid, HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		HeapTuple		tup;
+		StringInfoData	label;
+		MemoryContext	old;
+
+		/* the lookup can run invalidation callbacks, enter afterwards */
+		tup = SearchSysCache1(ENUMOID, ObjectIdGetDatum(enumoid));
+		if (!HeapTupleIsValid(tup))
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_BINARY_REPRESENTATION),
+					 errmsg("invalid internal value for enum: %u",
+							enumoid)));
+
+		old = MemoryContextSwitchTo(data->cache_context);
+		initStringInfo(&label);
+		pg_escape_json(&label, NameStr(((Form_pg_enum) GETSTRUCT(tup))->enumlabel));
+		MemoryContextSwitchTo(old);
+		ReleaseSysCache(tup);
+
+		entry = (JsonEnumEntry *) hash_search(JsonEnumCache, (void *) &enumoid, HASH_ENTER, NULL);
+		entry->label = label.data;
+		entry->len = label.len;
+	}
+
+	appendBinaryStringInfo(buf, entry->label, entry->len);
+}
+
+/*
+ * Append xid, timestamp and origin (format 2). They don't change within a
+ * transaction hence they are rendered once and copied into every object.
+ */
+static void
+pg_append_txn_fragment(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+
+	if (data->txn_fragment == NULL || data->fragment_txn != txn)
+	{
+		MemoryContext	old;
+		StringInfoData	buf;
+
+		old = MemoryContextSwitchTo(data->txn_context);
+		initStringInfo(&buf);
+
+		if (data->include_xids)
+			appendStringInfo(&buf, ",\"xid\":%u", txn->xid);
+
+		if (data->include_timestamp)
+		{
+			appendStringInfoString(&buf, ",\"timestamp\":");
+#if PG_VERSION_NUM >= 150000
+			pg_append_timestamp(data, &buf, txn->xact_time.commit_time);
+#else
+			pg_append_timestamp(data, &buf, txn->commit_time);
+#endif
+		}
+
+#if PG_VERSION_NUM >= 90500
+		if (data->include_origin)
+			appendStringInfo(&buf, ",\"origin\":%u", txn->origin_id);
+#endif
+
+		MemoryContextSwitchTo(old);
+
+		data->fragment_txn = txn;
+		data->txn_fragment = buf.data;
+		data->txn_fragment_len = buf.len;
+	}
+
+	appendBinaryStringInfo(ctx->out, data->txn_fragment, data->txn_fragment_len);
+}
+
+/*
+ * Produce a JSON string literal. Output is the same as escape_json() but runs
+ * of characters that do not need escaping are copied at once instead of one
+ * appendStringInfoCharMacro() per byte.
+ */
+static void
+pg_escape_json(StringInfo buf, const char *str)
+{
+	pg_escape_json_len(buf, str, strlen(str));
+}
+
+/* Same as pg_escape_json() for a string that is not null-terminated */
+static void
+pg_escape_json_len(StringInfo buf, const char *str, int len)
+{
+	const char *p;
+	const char *start;
+	const char *end = str + len;
+
+	appendStringInfoCharMacro(buf, '"');
+	for (p = start = str; p < end; p++)
+	{
+		unsigned char	c = (unsigned char) *p;
+
+		if (c >= ' ' && c != '"' && c != '\\')
+			continue;
+
+		if (p > start)
+			appendBinaryStringInfo(buf, start, p - start);
+		start = p + 1;
+
+		switch (c)
+		{
+			case '\b':
+				appendStringInfoString(buf, "\\b");
+				break;
+			case '\f':
+				appendStringInfoString(buf, "\\f");
+				break;
+			case '\n':
+				appendStringInfoString(buf, "\\n");
+				break;
+			case '\r':
+				appendStringInfoString(buf, "\\r");
+				break;
+			case '\t':
+				appendStringInfoString(buf, "\\t");
+				break;
+			case '"':
+				appendStringInfoString(buf, "\\\"");
+				break;
+			case '\\':
+				appendStringInfoString(buf, "\\\\");
+				break;
+			default:
+				appendStringInfo(buf, "\\u%04x", (int) c);
+				break;
+		}
+	}
+	if (p > start)
+		appendBinaryStringInfo(buf, start, p - start);
+	appendStringInfoCharMacro(buf, '"');
+}
+
+/*
+ * Render what precedes the columns of every change of this relation: the
+ * kind, schema and table lines (format 1) or the schema and table members
+ * (format 2).
+ */
+static void
+pg_build_relation_headers(JsonDecodingData *data, JsonRelationEntry *entry, char *schemaname, char *tablename)
+{
+	static const char *kinds[3] = {"insert", "update", "delete"};
+	MemoryContext	old;
+	StringInfoData	buf;
+	int				i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (entry->header[i] != NULL)
+			pfree(entry->header[i]);
+		entry->header[i] = NULL;
+	}
+	if (entry->names != NULL)
+		pfree(entry->names);
+	entry->names = NULL;
+
+	old = MemoryContextSwitchTo(data->cache_context);
+
+	if (data->format_version == 1)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			initStringInfo(&buf);
+			appendStringInfo(&buf, "{%s", data->nl);
+			appendStringInfo(&buf, "%s%s%s\"kind\":%s\"%s\",%s", data->ht, data->ht, data->ht, data->sp, kinds[i], data->nl);
+			if (data->include_schemas)
+			{
+				appendStringInfo(&buf, "%s%s%s\"schema\":%s", data->ht, data->ht, data->ht, data->sp);
+				pg_escape_json(&buf, schemaname);
+				appendStringInfo(&buf, ",%s", data->nl);
+			}
+			appendStringInfo(&buf, "%s%s%s\"table\":%s", data->ht, data->ht, data->ht, data->sp);
+			pg_escape_json(&buf, tablename);
+			appendStringInfo(&buf, ",%s", data->nl);
+
+			entry->header[i] = buf.data;
+			entry->headerlen[i] = buf.len;
+		}
+	}
+	else
+	{
+		initStringInfo(&buf);
+		if (data->include_schemas)
+		{
+			appendStringInfoString(&buf, ",\"schema\":");
+			pg_escape_json(&buf, schemaname);
+		}
+		appendStringInfoString(&buf, ",\"table\":");
+		pg_escape_json(&buf, tablename);
+
+		entry->names = buf.data;
+		entry->nameslen = buf.len;
+	}
+
+	MemoryContextSwitchTo(old);
+}
+
+/* Index of INSERT, UPDATE and DELETE in per-action arrays */
+static int
+pg_action_index(int change_type)
+{
+	switch (change_type)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+			return 0;
+		case REORDER_BUFFER_CHANGE_UPDATE:
+			return 1;
+		case REORDER_BUFFER_CHANGE_DELETE:
+			return 2;
+		default:
+			elog(ERROR, "unexpected change type %d", change_type);
+	}
+
+	return -1;					/* keep compiler quiet */
+}
+
+/*
+ * Make room for a change of this relation before it is encoded, so the output
+ * is enlarged at most once instead of doubling several times for wide rows.
+ * Returns where the change starts.
+ */
+static int
+pg_reserve_output(JsonDecodingData *data, JsonRelationEntry *entry, StringInfo out)
+{
+	int		maxlen = out->maxlen;
+
+	/* a reservation is only a hint; it must not exceed the allocation limit */
+	if (entry->maxsize > 0)
+		enlargeStringInfo(out, (int) Min((Size) entry->maxsize, MaxAllocSize - out->len - 1));
+	if (out->maxlen != maxlen)
+		data->nr_reserved++;
+	data->reserved_maxlen = out->maxlen;
+
+	return out->len;
+}
+
+/*
+ * Remember the encoded size of a change. The largest size decays towards the
+ * average so a single huge row does not inflate later reservations.
+ */
+static void
+pg_account_output(JsonDecodingData *data, JsonRelationEntry *entry, StringInfo out, int start)
+{
+	int		size = out->len - start;
+
+	if (out->maxlen != data->reserved_maxlen)
+		data->nr_enlarged++;
+
+	entry->avgsize += (size - entry->avgsize) / 8;
+	entry->maxsize -= (entry->maxsize - entry->avgsize) / 16;
+	if (size > entry->maxsize)
+		entry->maxsize = size;
+}
+
+static bool
+pg_filter_by_action(int change_type, JsonAction actions)
+{
+	if (change_type == REORDER_BUFFER_CHANGE_INSERT && !actions.insert)
+	{
+		elog(DEBUG3, "ignore INSERT");
+		return true;
+	}
+	if (change_type == REORDER_BUFFER_CHANGE_UPDATE && !actions.update)
+	{
+		elog(DEBUG3, "ignore UPDATE");
+		return true;
+	}
+	if (change_type == REORDER_BUFFER_CHANGE_DELETE && !actions.delete)
+	{
+		elog(DEBUG3, "ignore DELETE");
+		return true;
+	}
+
+	return false;
+}
+
+/* Does this table match the select table? */
+static bool
+pg_match_table(SelectTable *t, char *schemaname, char *tablename)
+{
+	bool	schemamatch;
+
+	if (t->allschemas)
+		schemamatch = true;
+	else if (t->schemapattern != NULL)
+		schemamatch = pg_match_pattern(t->schemapattern, schemaname);
+	else
+		schemamatch = (strcmp(t->schemaname, schemaname) == 0);
+
+	if (schemamatch)
+	{
+		if (t->alltables)
+			return true;
+		else if (t->tablepattern != NULL)
+			return pg_match_pattern(t->tablepattern, tablename);
+		else
+			return (strcmp(t->tablename, tablename) == 0);
+	}
+
+	return false;
+}
+
+/*
+ * Glob matching. '*' matches any sequence of characters and '?' matches any
+ * single character. Backslash escapes the next character.
+ */
+static bool
+pg_match_pattern(const char *pattern, const char *str)
+{
+	const char	*p = pattern;
+	const char	*s = str;
+	const char	*star_p = NULL;		/* pattern position after last '*' */
+	const char	*star_s = NULL;		/* string position matched by last '*' */
+
+	while (*s)
+	{
+		if (*p == '*')
+		{
+			star_p = ++p;
+			star_s = s;
+			continue;
+		}
+
+		if (*p == '?')
+		{
+			p++;
+			s += pg_mblen(s);
+			continue;
+		}
+
+		/* literal character (possibly escaped) */
+		if (*p == '\\' && *(p + 1) != '\0')
+			p++;
+		if (*p != '\0' && *p == *s)
+		{
+			p++;
+			s++;
+			continue;
+		}
+
+		/* mismatch; let the last '*' absorb one more character */
+		if (star_p != NULL)
+		{
+			p = star_p;
+			star_s += pg_mblen(star_s);
+			s = star_s;
+			continue;
+		}
+
+		return false;
+	}
+
+	/* trailing '*' matches empty string */
+	while (*p == '*')
+		p++;
+
+	return (*p == '\0');
+}
+
+/*
+ * Compile a regular expression that is matched against schema-qualified table
+ * names (schema.table). It is compiled once at startup.
+ */
+static regex_t *
+compile_table_regex(char *pattern, char *defname)
+{
+	regex_t		*re;
+	pg_wchar	*wpattern;
+	int			wlen;
+	int			len;
+	int			rc;
+
+	len = strlen(pattern);
+	wpattern = (pg_wchar *) palloc((len + 1) * sizeof(pg_wchar));
+	wlen = pg_mb2wchar_with_len(pattern, wpattern, len);
+
+	re = (regex_t *) palloc(sizeof(regex_t));
+	rc = pg_regcomp(re, wpattern, wlen, REG_ADVANCED | REG_NOSUB, C_COLLATION_OID);
+	pfree(wpattern);
+
+	if (rc != REG_OKAY)
+	{
+		char		errstr[100];
+
+		pg_regerror(rc, re, errstr, sizeof(errstr));
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_REGULAR_EXPRESSION),
+				 errmsg("could not parse value \"%s\" for parameter \"%s\": %s",
+					 pattern, defname, errstr)));
+	}
+
+	return re;
+}
+
+/* Does the schema-qualified table name match the regular expression? */
+static bool
+pg_match_table_regex(regex_t *re, char *schemaname, char *tablename)
+{
+	char		*qualname;
+	pg_wchar	*wqualname;
+	int			wlen;
+	int			len;
+	int			rc;
+
+	if (re == NULL)
+		return false;
+
+	qualname = psprintf("%s.%s", schemaname, tablename);
+	len = strlen(qualname);
+	wqualname = (pg_wchar *) palloc((len + 1) * sizeof(pg_wchar));
+	wlen = pg_mb2wchar_with_len(qualname, wqualname, len);
+
+	rc = pg_regexec(re, wqualname, wlen, 0, NULL, 0, NULL, 0);
+	if (rc != REG_OKAY && rc != REG_NOMATCH)
+	{
+		char		errstr[100];
+
+		pg_regerror(rc, re, errstr, sizeof(errstr));
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_REGULAR_EXPRESSION),
+				 errmsg("regular expression failed: %s", errstr)));
+	}
+
+	elog(DEBUG2, "\"%s\".\"%s\" %s regular expression", schemaname, tablename,
+				(rc == REG_OKAY) ? "matches" : "does not match");
+
+	pfree(qualname);
+	pfree(wqualname);
+
+	return (rc == REG_OKAY);
+}
+
+static bool
+pg_filter_by_table(List *filter_tables, char *schemaname, char *tablename)
+{
+	if (list_length(filter_tables) > 0)
+	{
+		ListCell	*lc;
+
+		foreach(lc, filter_tables)
+		{
+			SelectTable	*t = lfirst(lc);
+
+			if (pg_match_table(t, schemaname, tablename))
+			{
+				elog(DEBUG2, "\"%s\".\"%s\" was filtered out",
+							((t->allschemas) ? "*" : t->schemaname),
+							((t->alltables) ? "*" : t->tablename));
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
 
-#if PG_VERSION_NUM >= 90500
 static bool
-pg_filter_by_origin(LogicalDecodingContext *ctx, RepOriginId origin_id)
+pg_add_by_table(List *add_tables, char *schemaname, char *tablename)
 {
-	JsonDecodingData *data = ctx->output_plugin_private;
+	if (list_length(add_tables) > 0)
+	{
+		ListCell	*lc;
 
-	elog(DEBUG3, "origin: %u", origin_id);
+		/* all tables in all schemas are added by default */
+		foreach(lc, add_tables)
+		{
+			SelectTable	*t = lfirst(lc);
 
-	/* changes produced locally are never filtered */
-	if (origin_id == InvalidRepOriginId)
-		return false;
+			if (pg_match_table(t, schemaname, tablename))
+			{
+				elog(DEBUG2, "\"%s\".\"%s\" was added",
+							((t->allschemas) ? "*" : t->schemaname),
+							((t->alltables) ? "*" : t->tablename));
+				return true;
+			}
+		}
+	}
 
-	/* Filter origins, if available */
-	if (list_length(data->filter_origins) > 0 && list_member_oid(data->filter_origins, origin_id))
+	return false;
+}
+
+/*
+ * Return the first table-actions element that matches this table or NULL if
+ * global actions should be used.
+ */
+static SelectTable *
+pg_actions_by_table(List *table_actions, char *schemaname, char *tablename)
+{
+	ListCell	*lc;
+
+	foreach(lc, table_actions)
 	{
-		elog(DEBUG2, "origin \"%u\" was filtered out", origin_id);
-		return true;
+		SelectTable	*t = lfirst(lc);
+
+		if (pg_match_table(t, schemaname, tablename))
+		{
+			elog(DEBUG2, "\"%s\".\"%s\" has its own actions",
+						((t->allschemas) ? "*" : t->schemaname),
+						((t->alltables) ? "*" : t->tablename));
+			return t;
+		}
 	}
 
-	/*
-	 * There isn't a list of origins to filter or origin is not contained in
-	 * the filter list hence forward to all subscribers.
-	 */
-	return false;
+	return NULL;
 }
-#endif
 
-/* BEGIN callback */
+/* Callback for individual changed tuples */
 static void
-pg_decode_begin_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+				 Relation relation, ReorderBufferChange *change)
 {
 	JsonDecodingData *data = ctx->output_plugin_private;
 
+#if PG_VERSION_NUM >= 150000 && PG_VERSION_NUM < 160000
+	update_replication_progress(ctx, false);
+#elif PG_VERSION_NUM >= 140004 && PG_VERSION_NUM < 150000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 130008 && PG_VERSION_NUM < 140000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 120012 && PG_VERSION_NUM < 130000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 110017 && PG_VERSION_NUM < 120000
+	update_replication_progress(ctx);
+#elif PG_VERSION_NUM >= 100022 && PG_VERSION_NUM < 110000
+	update_replication_progress(ctx);
+#endif
+
+#if PG_VERSION_NUM >= 130000
+	if (data->publish_via_partition_root && relation->rd_rel->relispartition)
+	{
+		pg_decode_change_via_root(ctx, txn, relation, change);
+		return;
+	}
+#endif
+
 	if (data->format_version == 2)
-		pg_decode_begin_txn_v2(ctx, txn);
+		pg_decode_change_v2(ctx, txn, relation, change);
 	else if (data->format_version == 1)
-		pg_decode_begin_txn_v1(ctx, txn);
+		pg_decode_change_v1(ctx, txn, relation, change);
 	else
 		elog(ERROR, "format version %d is not supported", data->format_version);
 }
 
+#if PG_VERSION_NUM >= 130000
+/*
+ * Output a partition change as a change of its topmost ancestor. Filters are
+ * applied to the ancestor. Converted tuples are allocated in data->context
+ * hence they are released when the change is done.
+ */
 static void
-pg_decode_begin_txn_v1(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+pg_decode_change_via_root(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+				 Relation relation, ReorderBufferChange *change)
 {
-	JsonDecodingData *data = ctx->output_plugin_private;
-
-	data->nr_changes = 0;
+	JsonDecodingData	*data = ctx->output_plugin_private;
+	JsonRelationEntry	*entry;
+	Relation			ancestor;
+	ReorderBufferChange	mapped;
+	MemoryContext		old;
+#if PG_VERSION_NUM < 170000
+	ReorderBufferTupleBuf	newtuple;
+	ReorderBufferTupleBuf	oldtuple;
+#endif
 
-	/* Transaction starts */
-	OutputPluginPrepareWrite(ctx, true);
+	old = MemoryContextSwitchTo(data->context);
 
-	appendStringInfo(ctx->out, "{%s", data->nl);
+	entry = get_relation_entry(data, relation);
 
-	if (data->include_xids)
-		appendStringInfo(ctx->out, "%s\"xid\":%s%u,%s", data->ht, data->sp, txn->xid, data->nl);
+	ancestor = RelationIdGetRelation(entry->publish_as_relid);
+	if (!RelationIsValid(ancestor))
+		elog(ERROR, "could not open relation with OID %u", entry->publish_as_relid);
 
-	if (data->include_lsn)
+	mapped = *change;
+	if (entry->map != NULL)
 	{
-		char *lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(txn->end_lsn)));
-
-		appendStringInfo(ctx->out, "%s\"nextlsn\":%s\"%s\",%s", data->ht, data->sp, lsn_str, data->nl);
-
-		pfree(lsn_str);
-	}
-
-#if PG_VERSION_NUM >= 150000
-	if (data->include_timestamp)
-		appendStringInfo(ctx->out, "%s\"timestamp\":%s\"%s\",%s", data->ht, data->sp, timestamptz_to_str(txn->xact_time.commit_time), data->nl);
+#if PG_VERSION_NUM >= 170000
+		if (change->data.tp.newtuple != NULL)
+			mapped.data.tp.newtuple = execute_attr_map_tuple(change->data.tp.newtuple, entry->map);
+		if (change->data.tp.oldtuple != NULL)
+			mapped.data.tp.oldtuple = execute_attr_map_tuple(change->data.tp.oldtuple, entry->map);
 #else
-	if (data->include_timestamp)
-		appendStringInfo(ctx->out, "%s\"timestamp\":%s\"%s\",%s", data->ht, data->sp, timestamptz_to_str(txn->commit_time), data->nl);
+		if (change->data.tp.newtuple != NULL)
+		{
+			newtuple = *change->data.tp.newtuple;
+			newtuple.tuple = *execute_attr_map_tuple(&change->data.tp.newtuple->tuple, entry->map);
+			mapped.data.tp.newtuple = &newtuple;
+		}
+		if (change->data.tp.oldtuple != NULL)
+		{
+			oldtuple = *change->data.tp.oldtuple;
+			oldtuple.tuple = *execute_attr_map_tuple(&change->data.tp.oldtuple->tuple, entry->map);
+			mapped.data.tp.oldtuple = &oldtuple;
+		}
 #endif
+	}
 
-#if PG_VERSION_NUM >= 90500
-	if (data->include_origin)
-		appendStringInfo(ctx->out, "%s\"origin\":%s%u,%s", data->ht, data->sp, txn->origin_id, data->nl);
-#endif
+	MemoryContextSwitchTo(old);
 
-	appendStringInfo(ctx->out, "%s\"change\":%s[", data->ht, data->sp);
+	if (data->format_version == 2)
+		pg_decode_change_v2(ctx, txn, ancestor, &mapped);
+	else if (data->format_version == 1)
+		pg_decode_change_v1(ctx, txn, ancestor, &mapped);
+	else
+		elog(ERROR, "format version %d is not supported", data->format_version);
 
-	if (data->write_in_chunks)
-		OutputPluginWrite(ctx, true);
+	RelationClose(ancestor);
 }
+#endif
 
 static void
-pg_decode_begin_txn_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+pg_decode_change_v1(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+				 Relation relation, ReorderBufferChange *change)
 {
-	JsonDecodingData *data = ctx->output_plugin_private;
+	JsonDecodingData *data;
+	JsonRelationEntry *entry;
+	Form_pg_class class_form;
+	TupleDesc	tupdesc;
+	MemoryContext old;
 
-	/* don't include BEGIN object */
-	if (!data->include_transaction)
-		return;
+	JsonTuple	newtuple;
+	JsonTuple	oldtuple;
+	ReorderBufferChange routed;
+	int			action;
+	int			start;
+	int			i;
 
-	OutputPluginPrepareWrite(ctx, true);
-	appendStringInfoString(ctx->out, "{\"action\":\"B\"");
-	if (data->include_xids)
-		appendStringInfo(ctx->out, ",\"xid\":%u", txn->xid);
+	AssertVariableIsOfType(&pg_decode_change, LogicalDecodeChangeCB);
 
-#if PG_VERSION_NUM >= 150000
-	if (data->include_timestamp)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->xact_time.commit_time));
-#else
-	if (data->include_timestamp)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->commit_time));
-#endif
+	data = ctx->output_plugin_private;
 
-#if PG_VERSION_NUM >= 90500
-	if (data->include_origin)
-		appendStringInfo(ctx->out, ",\"origin\":%u", txn->origin_id);
-#endif
+	class_form = RelationGetForm(relation);
+	tupdesc = RelationGetDescr(relation);
 
-	if (data->include_lsn)
+	/* Avoid leaking memory by using and resetting our own context */
+	old = MemoryContextSwitchTo(data->context);
+
+	/* table filters and actions are evaluated once per relation */
+	entry = get_relation_entry(data, relation);
+
+	/* filter changes by action, table (filter-tables and add-tables) and shard */
+	if (pg_filter_by_action(change->action, entry->actions) || !entry->selected ||
+		(data->shard_count > 1 && pg_filter_by_shard(data, entry, tupdesc, change, &action)))
 	{
-		char *lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(txn->final_lsn)));
-		appendStringInfo(ctx->out, ",\"lsn\":\"%s\"", lsn_str);
-		pfree(lsn_str);
+		MemoryContextSwitchTo(old);
+		MemoryContextReset(data->context);
+		return;
+	}
 
-		lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(txn->end_lsn)));
-		appendStringInfo(ctx->out, ",\"nextlsn\":\"%s\"", lsn_str);
-		pfree(lsn_str);
+	/* the row moved to or from this shard */
+	if (data->shard_count > 1 && action != change->action)
+	{
+		routed = *change;
+		pg_shard_route_change(&routed, action);
+		change = &routed;
 	}
 
-	appendStringInfoChar(ctx->out, '}');
-	OutputPluginWrite(ctx, true);
-}
+	if (data->write_in_chunks)
+		OutputPluginPrepareWrite(ctx, true);
 
-/* COMMIT callback */
-static void
-pg_decode_commit_txn(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
-					 XLogRecPtr commit_lsn)
-{
-	JsonDecodingData *data = ctx->output_plugin_private;
+	/* Make sure rd_replidindex is set */
+	RelationGetIndexList(relation);
 
-	/*
-	 * Some older minor versions from back branches (10 to 14) calls
-	 * OutputPluginUpdateProgress(). That's before the fix
-	 * f95d53eded55ecbf037f6416ced6af29a2c3caca. After that,
-	 * update_replication_progress() function is used for back branches. In
-	 * version 15, update_replication_progress() changes the signature to
-	 * support skipped transactions. In version 16,
-	 * OutputPluginUpdateProgress() is back because a proper fix was added into
-	 * logical decoding.
-	 */
-#if PG_VERSION_NUM >= 160000
-	OutputPluginUpdateProgress(ctx, false);		/* XXX change 2nd param when skipped empty transaction is supported */
-#elif PG_VERSION_NUM >= 150000 && PG_VERSION_NUM < 160000
-	update_replication_progress(ctx, false);	/* XXX change 2nd param when skipped empty transaction is supported */
-#elif PG_VERSION_NUM >= 140004 && PG_VERSION_NUM < 150000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 130008 && PG_VERSION_NUM < 140000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 120012 && PG_VERSION_NUM < 130000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 110017 && PG_VERSION_NUM < 120000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 100022 && PG_VERSION_NUM < 110000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 140000 && PG_VERSION_NUM < 140004
-	OutputPluginUpdateProgress(ctx);
-#elif PG_VERSION_NUM >= 130000 && PG_VERSION_NUM < 130008
-	OutputPluginUpdateProgress(ctx);
-#elif PG_VERSION_NUM >= 120000 && PG_VERSION_NUM < 120012
-	OutputPluginUpdateProgress(ctx);
-#elif PG_VERSION_NUM >= 110000 && PG_VERSION_NUM < 110017
-	OutputPluginUpdateProgress(ctx);
-#elif PG_VERSION_NUM >= 100000 && PG_VERSION_NUM < 100022
-	OutputPluginUpdateProgress(ctx);
-#endif
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+			if (change->data.tp.newtuple == NULL)
+			{
+				elog(WARNING, "no tuple data for INSERT in table \"%s\"", NameStr(class_form->relname));
+				MemoryContextSwitchTo(old);
+				MemoryContextReset(data->context);
+				return;
+			}
+			break;
+		case REORDER_BUFFER_CHANGE_UPDATE:
+			/*
+			 * Bail out iif:
+			 * (i) doesn't have a pk and replica identity is not full;
+			 * (ii) replica identity is nothing.
+			 */
+			if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+			{
+				/* FIXME this sentence is imprecise */
+				elog(WARNING, "table \"%s\" without primary key or replica identity is nothing", NameStr(class_form->relname));
+				MemoryContextSwitchTo(old);
+				MemoryContextReset(data->context);
+				return;
+			}
 
-	elog(DEBUG2, "my change counter: " UINT64_FORMAT " ; # of changes: " UINT64_FORMAT " ; # of changes in memory: " UINT64_FORMAT, data->nr_changes, txn->nentries, txn->nentries_mem);
-	elog(DEBUG2, "# of subxacts: %d", txn->nsubtxns);
+			if (change->data.tp.newtuple == NULL)
+			{
+				elog(WARNING, "no tuple data for UPDATE in table \"%s\"", NameStr(class_form->relname));
+				MemoryContextSwitchTo(old);
+				MemoryContextReset(data->context);
+				return;
+			}
+			break;
+		case REORDER_BUFFER_CHANGE_DELETE:
+			/*
+			 * Bail out iif:
+			 * (i) doesn't have a pk and replica identity is not full;
+			 * (ii) replica identity is nothing.
+			 */
+			if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+			{
+				/* FIXME this sentence is imprecise */
+				elog(WARNING, "table \"%s\" without primary key or replica identity is nothing", NameStr(class_form->relname));
+				MemoryContextSwitchTo(old);
+				MemoryContextReset(data->context);
+				return;
+			}
 
-	if (data->format_version == 2)
-		pg_decode_commit_txn_v2(ctx, txn, commit_lsn);
-	else if (data->format_version == 1)
-		pg_decode_commit_txn_v1(ctx, txn, commit_lsn);
-	else
-		elog(ERROR, "format version %d is not supported", data->format_version);
-}
+			if (change->data.tp.oldtuple == NULL)
+			{
+				elog(WARNING, "no tuple data for DELETE in table \"%s\"", NameStr(class_form->relname));
+				MemoryContextSwitchTo(old);
+				MemoryContextReset(data->context);
+				return;
+			}
+			break;
+		default:
+			Assert(false);
+	}
 
-static void
-pg_decode_commit_txn_v1(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
-					 XLogRecPtr commit_lsn)
-{
-	JsonDecodingData *data = ctx->output_plugin_private;
+	/* Change counter */
+	data->nr_changes++;
 
-	/* Transaction ends */
-	if (data->write_in_chunks)
-		OutputPluginPrepareWrite(ctx, true);
+	start = pg_reserve_output(data, entry, ctx->out);
 
 	/* if we don't write in chunks, we need a newline here */
 	if (!data->write_in_chunks)
 		appendStringInfo(ctx->out, "%s", data->nl);
 
-	appendStringInfo(ctx->out, "%s]%s}", data->ht, data->nl);
+	appendStringInfo(ctx->out, "%s%s", data->ht, data->ht);
 
-	OutputPluginWrite(ctx, true);
-}
+	if (data->nr_changes > 1)
+		appendStringInfoChar(ctx->out, ',');
 
-static void
-pg_decode_commit_txn_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
-					 XLogRecPtr commit_lsn)
-{
-	JsonDecodingData *data = ctx->output_plugin_private;
+	/* Print change kind and table name (possibly) qualified */
+	i = pg_action_index(change->action);
+	appendBinaryStringInfo(ctx->out, entry->header[i], entry->headerlen[i]);
 
-	/* don't include COMMIT object */
-	if (!data->include_transaction)
-		return;
+	/* tuples are deformed once for all sections */
+#if PG_VERSION_NUM >= 170000
+	pg_json_tuple_init(&newtuple, change->data.tp.newtuple);
+	pg_json_tuple_init(&oldtuple, change->data.tp.oldtuple);
+#else
+	pg_json_tuple_init(&newtuple, change->data.tp.newtuple ? &change->data.tp.newtuple->tuple : NULL);
+	pg_json_tuple_init(&oldtuple, change->data.tp.oldtuple ? &change->data.tp.oldtuple->tuple : NULL);
+#endif
 
-	OutputPluginPrepareWrite(ctx, true);
-	appendStringInfoString(ctx->out, "{\"action\":\"C\"");
-	if (data->include_xids)
-		appendStringInfo(ctx->out, ",\"xid\":%u", txn->xid);
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+			/* Print the new tuple */
+#if	PG_VERSION_NUM >= 100000
+			if (data->include_pk && OidIsValid(relation->rd_pkindex))
+#else
+			if (data->include_pk && OidIsValid(relation->rd_replidindex) &&
+					relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
+#endif
+			{
+				columns_to_stringinfo(ctx, tupdesc, &newtuple, true, relation);
+				pk_to_stringinfo(ctx, relation, false);
+			}
+			else
+			{
+				columns_to_stringinfo(ctx, tupdesc, &newtuple, false, relation);
+			}
+			break;
+		case REORDER_BUFFER_CHANGE_UPDATE:
+			/* Print the new tuple */
+			columns_to_stringinfo(ctx, tupdesc, &newtuple, true, relation);
 
-#if PG_VERSION_NUM >= 150000
-	if (data->include_timestamp)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->xact_time.commit_time));
+#if	PG_VERSION_NUM >= 100000
+			if (data->include_pk && OidIsValid(relation->rd_pkindex))
 #else
-	if (data->include_timestamp)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->commit_time));
+			if (data->include_pk && OidIsValid(relation->rd_replidindex) &&
+					relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
 #endif
+			{
+				pk_to_stringinfo(ctx, relation, true);
+			}
 
-#if PG_VERSION_NUM >= 90500
-	if (data->include_origin)
-		appendStringInfo(ctx->out, ",\"origin\":%u", txn->origin_id);
+			/*
+			 * The old tuple is available when:
+			 * (i) pk changes;
+			 * (ii) replica identity is full;
+			 * (iii) replica identity is index and indexed column changes.
+			 *
+			 * FIXME if old tuple is not available we must get only the indexed
+			 * columns (the whole tuple is printed).
+			 */
+			if (change->data.tp.oldtuple == NULL)
+			{
+				elog(DEBUG1, "old tuple is null");
+
+				identity_to_stringinfo(ctx, tupdesc, &newtuple, true, relation);
+			}
+			else
+			{
+				elog(DEBUG1, "old tuple is not null");
+				identity_to_stringinfo(ctx, tupdesc, &oldtuple, false, relation);
+			}
+			break;
+		case REORDER_BUFFER_CHANGE_DELETE:
+#if	PG_VERSION_NUM >= 100000
+			if (data->include_pk && OidIsValid(relation->rd_pkindex))
+#else
+			if (data->include_pk && OidIsValid(relation->rd_replidindex) &&
+					relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
 #endif
+			{
+				pk_to_stringinfo(ctx, relation, true);
+			}
 
-	if (data->include_lsn)
-	{
-		char *lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(commit_lsn)));
-		appendStringInfo(ctx->out, ",\"lsn\":\"%s\"", lsn_str);
-		pfree(lsn_str);
+			identity_to_stringinfo(ctx, tupdesc, &oldtuple, true, relation);
 
-		lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(txn->end_lsn)));
-		appendStringInfo(ctx->out, ",\"nextlsn\":\"%s\"", lsn_str);
-		pfree(lsn_str);
+			if (change->data.tp.oldtuple == NULL)
+				elog(DEBUG1, "old tuple is null");
+			else
+				elog(DEBUG1, "old tuple is not null");
+			break;
+		default:
+			Assert(false);
 	}
 
-	appendStringInfoChar(ctx->out, '}');
-	OutputPluginWrite(ctx, true);
+	appendStringInfo(ctx->out, "%s%s}", data->ht, data->ht);
+
+	pg_account_output(data, entry, ctx->out, start);
+
+	MemoryContextSwitchTo(old);
+	MemoryContextReset(data->context);
+
+	if (data->write_in_chunks)
+		OutputPluginWrite(ctx, true);
 }
 
 /*
- * Accumulate tuple information and stores it at the end
- *
- * replident: is this tuple a replica identity?
+ * Get the relation entry with its column plan, building the plan if it is the
+ * first tuple since the relation was (re)loaded.
  */
-static void
-tuple_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, Bitmapset *bs, bool replident, bool addcomma, Relation relation)
+static JsonRelationEntry *
+get_column_plan(JsonDecodingData *data, Relation relation)
 {
-	JsonDecodingData	*data;
-	int					natt;
-
-	StringInfoData		colnames;
-	StringInfoData		coltypes;
-	StringInfoData		coltypeoids;
-	StringInfoData		colpositions;
-	StringInfoData		colnotnulls;
-	StringInfoData		coldefaults;
-	StringInfoData		colvalues;
-	char				comma[3] = "";
-
+	JsonRelationEntry	*entry;
+	TupleDesc			tupdesc;
 	Relation			defrel = NULL;
+	Bitmapset			*ribs;
+	Bitmapset			*pkbs;
+	MemoryContext		old;
+	int					i;
 
-	data = ctx->output_plugin_private;
+	entry = get_relation_entry(data, relation);
+	if (entry->columns != NULL)
+		return entry;
 
-	initStringInfo(&colnames);
-	initStringInfo(&coltypes);
-	if (data->include_type_oids)
-		initStringInfo(&coltypeoids);
-	if (data->include_column_positions)
-		initStringInfo(&colpositions);
-	if (data->include_not_null)
-		initStringInfo(&colnotnulls);
+	/* open pg_attrdef in preparation to get default values from columns */
 	if (data->include_default)
-		initStringInfo(&coldefaults);
-	initStringInfo(&colvalues);
-
-	/*
-	 * If replident is true, it will output info about replica identity. In this
-	 * case, there are special JSON objects for it. Otherwise, it will print new
-	 * tuple data.
-	 */
-	if (replident)
-	{
-		appendStringInfo(&colnames, "%s%s%s\"oldkeys\":%s{%s", data->ht, data->ht, data->ht, data->sp, data->nl);
-		appendStringInfo(&colnames, "%s%s%s%s\"keynames\":%s[", data->ht, data->ht, data->ht, data->ht, data->sp);
-		appendStringInfo(&coltypes, "%s%s%s%s\"keytypes\":%s[", data->ht, data->ht, data->ht, data->ht, data->sp);
-		if (data->include_type_oids)
-			appendStringInfo(&coltypeoids, "%s%s%s%s\"keytypeoids\":%s[", data->ht, data->ht, data->ht, data->ht, data->sp);
-		appendStringInfo(&colvalues, "%s%s%s%s\"keyvalues\":%s[", data->ht, data->ht, data->ht, data->ht, data->sp);
-	}
-	else
-	{
-		appendStringInfo(&colnames, "%s%s%s\"columnnames\":%s[", data->ht, data->ht, data->ht, data->sp);
-		appendStringInfo(&coltypes, "%s%s%s\"columntypes\":%s[", data->ht, data->ht, data->ht, data->sp);
-		if (data->include_type_oids)
-			appendStringInfo(&coltypeoids, "%s%s%s\"columntypeoids\":%s[", data->ht, data->ht, data->ht, data->sp);
-		if (data->include_column_positions)
-			appendStringInfo(&colpositions, "%s%s%s\"columnpositions\":%s[", data->ht, data->ht, data->ht, data->sp);
-		if (data->include_not_null)
-			appendStringInfo(&colnotnulls, "%s%s%s\"columnoptionals\":%s[", data->ht, data->ht, data->ht, data->sp);
-		if (data->include_default)
-			appendStringInfo(&coldefaults, "%s%s%s\"columndefaults\":%s[", data->ht, data->ht, data->ht, data->sp);
-		appendStringInfo(&colvalues, "%s%s%s\"columnvalues\":%s[", data->ht, data->ht, data->ht, data->sp);
-	}
-
-	if (!replident && data->include_default)
 	{
 #if PG_VERSION_NUM >= 120000
 		defrel = table_open(AttrDefaultRelationId, AccessShareLock);
@@ -1101,1465 +4641,1647 @@ tuple_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tu
 #endif
 	}
 
-	/* Print column information (name, type, value) */
-	for (natt = 0; natt < tupdesc->natts; natt++)
+	entry->plan_context = AllocSetContextCreate(data->cache_context,
+										"wal2json column plan",
+#if PG_VERSION_NUM >= 90600
+										ALLOCSET_SMALL_SIZES
+#else
+										ALLOCSET_SMALL_MINSIZE,
+										ALLOCSET_SMALL_INITSIZE,
+										ALLOCSET_SMALL_MAXSIZE
+#endif
+										);
+
+	old = MemoryContextSwitchTo(entry->plan_context);
+
+	tupdesc = RelationGetDescr(relation);
+	ribs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_IDENTITY_KEY);
+#if PG_VERSION_NUM >= 100000
+	pkbs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_PRIMARY_KEY);
+#else
+	pkbs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_KEY);
+#endif
+
+	entry->columns = (JsonColumn *) palloc(Max(tupdesc->natts, 1) * sizeof(JsonColumn));
+	entry->ncolumns = 0;
+	entry->nidentity = 0;
+	entry->npk = 0;
+
+	for (i = 0; i < tupdesc->natts; i++)
 	{
-		Form_pg_attribute	attr;		/* the attribute itself */
-		Oid					typid;		/* type of current attribute */
-		HeapTuple			type_tuple;	/* information about a type */
-		Oid					typoutput;	/* output function */
-		bool				typisvarlena;
-		Datum				origval;	/* possibly toasted Datum */
-		Datum				val;		/* definitely detoasted Datum */
-		char				*outputstr = NULL;
-		bool				isnull;		/* column is null? */
+		Form_pg_attribute	attr;
+		JsonColumn			*col;
+		Oid					typoutfunc;
 
-		/*
-		 * Commit d34a74dd064af959acd9040446925d9d53dff15b introduced
-		 * TupleDescAttr() in back branches. If the version supports
-		 * this macro, use it. Version 10 and later already support it.
-		 */
 #if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
-		attr = tupdesc->attrs[natt];
+		attr = tupdesc->attrs[i];
 #else
-		attr = TupleDescAttr(tupdesc, natt);
+		attr = TupleDescAttr(tupdesc, i);
 #endif
 
-		elog(DEBUG1, "attribute \"%s\" (%d/%d)", NameStr(attr->attname), natt, tupdesc->natts);
-
-		/* Do not print dropped or system columns */
+		/* skip dropped or system columns */
 		if (attr->attisdropped || attr->attnum < 0)
 			continue;
 
-		/* Replica identity column? */
-		if (bs != NULL && !bms_is_member(attr->attnum - FirstLowInvalidHeapAttributeNumber, bs))
-			continue;
+		col = &entry->columns[entry->ncolumns++];
+		col->attidx = i;
+		/* without a key (e.g. REPLICA IDENTITY FULL), all columns are used */
+		col->identity = (ribs == NULL || bms_is_member(attr->attnum - FirstLowInvalidHeapAttributeNumber, ribs));
+		col->pk = (pkbs == NULL || bms_is_member(attr->attnum - FirstLowInvalidHeapAttributeNumber, pkbs));
+		/* under REPLICA IDENTITY FULL, identity is the whole old tuple */
+		col->rikey = (ribs != NULL && col->identity);
+		if (col->identity)
+			entry->nidentity++;
+		if (col->pk)
+			entry->npk++;
+		col->kind = pg_value_kind(data, attr->atttypid);
+		col->typid = attr->atttypid;
+		col->typhash = GetSysCacheHashValue1(TYPEOID, ObjectIdGetDatum(attr->atttypid));
+		col->elide = pg_elide_type(data, attr->atttypid);
+		if (col->elide)
+			get_typlenbyval(attr->atttypid, &col->typlen, &col->typbyval);
+
+		getTypeOutputInfo(attr->atttypid, &typoutfunc, &col->isvarlena);
+		fmgr_info_cxt(typoutfunc, &col->outfunc, entry->plan_context);
 
-		/* Get Datum from tuple */
-		origval = heap_getattr(tuple, natt + 1, tupdesc, &isnull);
+		if (data->include_default)
+			col->defval = pg_column_default(relation, defrel, attr);
+		else
+			col->defval = NULL;
 
-		/* Skip nulls iif printing key/identity */
-		if (isnull && replident)
-			continue;
+		if (data->format_version == 1)
+			pg_build_column_v1(data, attr, col);
+		else
+			pg_build_column_fragments(data, attr, col);
+	}
 
-		typid = attr->atttypid;
+	bms_free(ribs);
+	bms_free(pkbs);
 
-		/* Figure out type name */
-		type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
-		if (!HeapTupleIsValid(type_tuple))
-			elog(ERROR, "cache lookup failed for type %u", typid);
+	MemoryContextSwitchTo(old);
+
+	/* close pg_attrdef */
+	if (data->include_default)
+	{
+#if PG_VERSION_NUM >= 120000
+		table_close(defrel, AccessShareLock);
+#else
+		heap_close(defrel, AccessShareLock);
+#endif
+	}
 
-		/* Get information needed for printing values of a type */
-		getTypeOutputInfo(typid, &typoutput, &typisvarlena);
+	return entry;
+}
 
-		/* XXX Unchanged TOAST Datum does not need to be output */
-		if (!isnull && typisvarlena && VARATT_IS_EXTERNAL_ONDISK(origval))
-		{
-			elog(DEBUG1, "column \"%s\" has an unchanged TOAST", NameStr(attr->attname));
-			continue;
-		}
+/* Prepare a tuple to be written; nothing is fetched until it is needed */
+static void
+pg_json_tuple_init(JsonTuple *jt, HeapTuple tuple)
+{
+	memset(jt, 0, sizeof(JsonTuple));
+	jt->tuple = tuple;
+}
 
-		/* Accumulate each column info */
-		appendStringInfo(&colnames, "%s", comma);
-		escape_json(&colnames, NameStr(attr->attname));
+/*
+ * Fetch the columns that are written. If only key columns are printed, the
+ * other columns are not extracted.
+ */
+static void
+pg_json_tuple_fetch(JsonTuple *jt, TupleDesc tupdesc, JsonRelationEntry *entry, bool keys, bool identity)
+{
+	int		i;
 
-		if (data->include_types)
-		{
-			char	*type_str;
-			int		len;
-			Form_pg_type type_form = (Form_pg_type) GETSTRUCT(type_tuple);
+	if (jt->values == NULL)
+	{
+		jt->fetched = (bool *) palloc0(tupdesc->natts * sizeof(bool));
+		jt->values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+		jt->nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+		jt->encstart = (int *) palloc(tupdesc->natts * sizeof(int));
+		jt->enclen = (int *) palloc(tupdesc->natts * sizeof(int));
+		for (i = 0; i < tupdesc->natts; i++)
+			jt->encstart[i] = -1;
+	}
 
-			/*
-			 * It is a domain. Replace domain name with base data type if
-			 * include_domain_data_type is enabled.
-			 */
-			if (type_form->typtype == TYPTYPE_DOMAIN && data->include_domain_data_type)
-			{
-				typid = type_form->typbasetype;
-				if (data->include_typmod)
-				{
-					getTypeOutputInfo(typid, &typoutput, &typisvarlena);
-					type_str = format_type_with_typemod(type_form->typbasetype, type_form->typtypmod);
-				}
-				else
-				{
-					/*
-					 * Since we are not using a format function, grab base type
-					 * name from Form_pg_type.
-					 */
-					type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
-					if (!HeapTupleIsValid(type_tuple))
-						elog(ERROR, "cache lookup failed for type %u", typid);
-					type_form = (Form_pg_type) GETSTRUCT(type_tuple);
-					type_str = pstrdup(NameStr(type_form->typname));
-				}
-			}
-			else
-			{
-				if (data->include_typmod)
-					type_str = TextDatumGetCString(DirectFunctionCall2(format_type, attr->atttypid, attr->atttypmod));
-				else
-					type_str = pstrdup(NameStr(type_form->typname));
-			}
+	if (jt->deformed)
+		return;
 
-			appendStringInfo(&coltypes, "%s", comma);
-			/*
-			 * format_type() returns a quoted identifier, if
-			 * required. In this case, it doesn't need to enclose the type name
-			 * in double quotes. However, if it is an array type, it should
-			 * escape it because the brackets are outside the double quotes.
-			 */
-			len = strlen(type_str);
-			if (type_str[0] == '"' && type_str[len - 1] != ']')
-				appendStringInfo(&coltypes, "%s", type_str);
-			else
-				escape_json(&coltypes, type_str);
+	if (!keys || (identity ? entry->nidentity : entry->npk) == entry->ncolumns)
+	{
+		heap_deform_tuple(jt->tuple, tupdesc, jt->values, jt->nulls);
+		jt->deformed = true;
+		return;
+	}
 
-			pfree(type_str);
+	for (i = 0; i < entry->ncolumns; i++)
+	{
+		JsonColumn	*col = &entry->columns[i];
+		int			j = col->attidx;
 
-			/* oldkeys doesn't print not-null constraints */
-			if (!replident && data->include_not_null)
-			{
-				if (attr->attnotnull)
-					appendStringInfo(&colnotnulls, "%sfalse", comma);
-				else
-					appendStringInfo(&colnotnulls, "%strue", comma);
-			}
+		if ((identity ? col->identity : col->pk) && !jt->fetched[j])
+		{
+			jt->values[j] = heap_getattr(jt->tuple, j + 1, tupdesc, &jt->nulls[j]);
+			jt->fetched[j] = true;
 		}
+	}
+}
+
+/*
+ * Write a column value, encoding it only the first time. Values of replica
+ * identity index columns are not elided in key sections because they identify
+ * the row; they are not kept for other sections that would elide them.
+ */
+static void
+pg_json_tuple_write_value(LogicalDecodingContext *ctx, JsonTuple *jt, JsonColumn *col, bool key)
+{
+	int		j = col->attidx;
+	int		start;
 
-		if (data->include_type_oids)
-			appendStringInfo(&coltypeoids, "%s%u", comma, typid);
+	if (key && col->rikey && !jt->nulls[j] &&
+		pg_elide_value(ctx->output_plugin_private, col, jt->values[j]))
+	{
+		pg_decode_write_value(ctx, col, jt->values[j], false, false);
+		return;
+	}
 
-		ReleaseSysCache(type_tuple);
+	if (jt->encstart[j] >= 0)
+	{
+		/* enlarge first, the buffer might move */
+		enlargeStringInfo(ctx->out, jt->enclen[j]);
+		memcpy(ctx->out->data + ctx->out->len, ctx->out->data + jt->encstart[j], jt->enclen[j]);
+		ctx->out->len += jt->enclen[j];
+		ctx->out->data[ctx->out->len] = '\0';
+		return;
+	}
 
-		if (!replident && data->include_column_positions)
-			appendStringInfo(&colpositions, "%s%d", comma, attr->attnum);
+	start = ctx->out->len;
+	pg_decode_write_value(ctx, col, jt->values[j], jt->nulls[j], true);
+	jt->encstart[j] = start;
+	jt->enclen[j] = ctx->out->len - start;
+}
+
+/*
+ * Default expression of this column as a JSON value. The expression is not
+ * escaped, for compatibility.
+ */
+static char *
+pg_column_default(Relation relation, Relation defrel, Form_pg_attribute attr)
+{
+	char	*defval = NULL;
 
-		/*
-		 * Print default for columns.
-		 */
-		if (!replident && data->include_default)
-		{
 #if PG_VERSION_NUM >= 120000
-			if (attr->atthasdef && attr->attgenerated == '\0')
+	if (attr->atthasdef && attr->attgenerated == '\0')
 #else
-			if (attr->atthasdef)
-#endif
-			{
-				ScanKeyData			scankeys[2];
-				SysScanDesc			scan;
-				HeapTuple			def_tuple;
-				Datum				def_value;
-				bool				attisnull;
-				char				*result;
-
-				ScanKeyInit(&scankeys[0],
-							Anum_pg_attrdef_adrelid,
-							BTEqualStrategyNumber, F_OIDEQ,
-							ObjectIdGetDatum(relation->rd_id));
-				ScanKeyInit(&scankeys[1],
-							Anum_pg_attrdef_adnum,
-							BTEqualStrategyNumber, F_INT2EQ,
-							Int16GetDatum(attr->attnum));
-
-				scan = systable_beginscan(defrel, AttrDefaultIndexId, true,
-											NULL, 2, scankeys);
-
-				def_tuple = systable_getnext(scan);
-				if (HeapTupleIsValid(def_tuple))
-				{
-					def_value = fastgetattr(def_tuple, Anum_pg_attrdef_adbin, defrel->rd_att, &attisnull);
-
-					if (!attisnull)
-					{
-						result = TextDatumGetCString(DirectFunctionCall2(pg_get_expr,
-																	def_value,
-																	ObjectIdGetDatum(relation->rd_id)));
+	if (attr->atthasdef)
+#endif
+	{
+		ScanKeyData			scankeys[2];
+		SysScanDesc			scan;
+		HeapTuple			def_tuple;
+		Datum				def_value;
+		bool				isnull;
+		char				*result;
+
+		ScanKeyInit(&scankeys[0],
+					Anum_pg_attrdef_adrelid,
+					BTEqualStrategyNumber, F_OIDEQ,
+					ObjectIdGetDatum(relation->rd_id));
+		ScanKeyInit(&scankeys[1],
+					Anum_pg_attrdef_adnum,
+					BTEqualStrategyNumber, F_INT2EQ,
+					Int16GetDatum(attr->attnum));
+
+		scan = systable_beginscan(defrel, AttrDefaultIndexId, true,
+									NULL, 2, scankeys);
+
+		def_tuple = systable_getnext(scan);
+		if (HeapTupleIsValid(def_tuple))
+		{
+			def_value = fastgetattr(def_tuple, Anum_pg_attrdef_adbin, defrel->rd_att, &isnull);
 
-						appendStringInfo(&coldefaults, "%s\"%s\"", comma, result);
-						pfree(result);
-					}
-					else
-					{
-						/*
-						 * null means that default was not set. Is it possible?
-						 * atthasdef shouldn't be set.
-						 */
-						appendStringInfo(&coldefaults, "%snull", comma);
-					}
-				}
+			if (!isnull)
+			{
+				result = TextDatumGetCString(DirectFunctionCall2(pg_get_expr,
+															def_value,
+															ObjectIdGetDatum(relation->rd_id)));
 
-				systable_endscan(scan);
+				defval = psprintf("\"%s\"", result);
+				pfree(result);
 			}
 			else
 			{
 				/*
-				 * no DEFAULT clause implicitly means that the default is NULL
+				 * null means that default was not set. Is it possible?
+				 * atthasdef shouldn't be set.
 				 */
-				appendStringInfo(&coldefaults, "%snull", comma);
+				defval = pstrdup("null");
 			}
 		}
 
-		if (isnull)
-		{
-			appendStringInfo(&colvalues, "%snull", comma);
-		}
-		else
-		{
-			if (typisvarlena)
-				val = PointerGetDatum(PG_DETOAST_DATUM(origval));
-			else
-				val = origval;
+		systable_endscan(scan);
+	}
+	else
+	{
+		/*
+		 * no DEFAULT clause implicitly means that the default is NULL
+		 */
+		defval = pstrdup("null");
+	}
 
-			/* Finally got the value */
-			outputstr = OidOutputFunctionCall(typoutput, val);
+	return defval;
+}
 
-			/*
-			 * Data types are printed with quotes unless they are number, true,
-			 * false, null, an array or an object.
-			 *
-			 * The NaN and Infinity are not valid JSON symbols. Hence,
-			 * regardless of sign they are represented as the string null.
-			 *
-			 * Exception to this is when data->numeric_data_types_as_string is
-			 * true. In this case, numbers (including NaN and Infinity values)
-			 * are printed with quotes.
-			 */
-			switch (typid)
-			{
-				case INT2OID:
-				case INT4OID:
-				case INT8OID:
-				case OIDOID:
-				case FLOAT4OID:
-				case FLOAT8OID:
-				case NUMERICOID:
-					if (data->numeric_data_types_as_string) {
-						if (strspn(outputstr, "0123456789+-eE.") == strlen(outputstr) ||
-								pg_strncasecmp(outputstr, "NaN", 3) == 0 ||
-								pg_strncasecmp(outputstr, "Infinity", 8) == 0 ||
-								pg_strncasecmp(outputstr, "-Infinity", 9) == 0) {
-							appendStringInfo(&colvalues, "%s", comma);
-							escape_json(&colvalues, outputstr);
-						} else {
-							elog(ERROR, "%s is not a number", outputstr);
-						}
-					}
-					else if (pg_strncasecmp(outputstr, "NaN", 3) == 0 ||
-							pg_strncasecmp(outputstr, "Infinity", 8) == 0 ||
-							pg_strncasecmp(outputstr, "-Infinity", 9) == 0)
-					{
-						appendStringInfo(&colvalues, "%snull", comma);
-						elog(DEBUG1, "attribute \"%s\" is special: %s", NameStr(attr->attname), outputstr);
-					}
-					else if (strspn(outputstr, "0123456789+-eE.") == strlen(outputstr))
-						appendStringInfo(&colvalues, "%s%s", comma, outputstr);
-					else
-						elog(ERROR, "%s is not a number", outputstr);
-					break;
-				case BOOLOID:
-					if (strcmp(outputstr, "t") == 0)
-						appendStringInfo(&colvalues, "%strue", comma);
-					else
-						appendStringInfo(&colvalues, "%sfalse", comma);
-					break;
-				case BYTEAOID:
-					appendStringInfo(&colvalues, "%s", comma);
-					/* string is "\x54617069727573", start after "\x" */
-					escape_json(&colvalues, (outputstr + 2));
-					break;
-				default:
-					appendStringInfo(&colvalues, "%s", comma);
-					escape_json(&colvalues, outputstr);
-					break;
-			}
-		}
+/*
+ * Build what is written before and after the value of this column. Only the
+ * new tuple (INSERT, UPDATE) has the suffix; key columns are closed right
+ * after the value.
+ */
+static void
+pg_build_column_fragments(JsonDecodingData *data, Form_pg_attribute attr, JsonColumn *col)
+{
+	StringInfoData	buf;
 
-		/* The first column does not have comma */
-		if (strcmp(comma, "") == 0)
-			snprintf(comma, 3, ",%s", data->sp);
-	}
+	initStringInfo(&buf);
+	appendStringInfoString(&buf, "{\"name\":");
+	pg_escape_json(&buf, NameStr(attr->attname));
 
-	if (!replident && data->include_default)
+	/* type name (with typmod, if available) */
+	if (data->include_types)
 	{
-#if PG_VERSION_NUM >= 120000
-		table_close(defrel, AccessShareLock);
-#else
-		heap_close(defrel, AccessShareLock);
-#endif
+		HeapTuple		type_tuple;
+		Form_pg_type	type_form;
+		char			*type_str;
+		int				len;
+
+		type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(attr->atttypid));
+		if (!HeapTupleIsValid(type_tuple))
+			elog(ERROR, "cache lookup failed for type %u", attr->atttypid);
+		type_form = (Form_pg_type) GETSTRUCT(type_tuple);
+
+		/*
+		 * It is a domain. Replace domain name with base data type if
+		 * include_domain_data_type is enabled.
+		 */
+		if (type_form->typtype == TYPTYPE_DOMAIN && data->include_domain_data_type)
+			type_str = format_type_with_typemod(type_form->typbasetype, type_form->typtypmod);
+		else
+			type_str = format_type_with_typemod(attr->atttypid, attr->atttypmod);
+
+		appendStringInfoString(&buf, ",\"type\":");
+		/*
+		 * format_type_with_typemod() returns a quoted identifier, if
+		 * required. In this case, it doesn't need to enclose the type name
+		 * in double quotes. However, if it is an array type, it should
+		 * escape it because the brackets are outside the double quotes.
+		 */
+		len = strlen(type_str);
+		if (type_str[0] == '"' && type_str[len -1] != ']')
+			appendStringInfoString(&buf, type_str);
+		else
+			pg_escape_json(&buf, type_str);
+		pfree(type_str);
+
+		ReleaseSysCache(type_tuple);
 	}
 
-	/* Column info ends */
-	if (replident)
+	/*
+	 * Print type oid for columns.
+	 */
+	if (data->include_type_oids)
 	{
-		appendStringInfo(&colnames, "],%s", data->nl);
-		if (data->include_types)
-			appendStringInfo(&coltypes, "],%s", data->nl);
-		if (data->include_type_oids)
-			appendStringInfo(&coltypeoids, "],%s", data->nl);
-		appendStringInfo(&colvalues, "]%s", data->nl);
-		appendStringInfo(&colvalues, "%s%s%s}%s", data->ht, data->ht, data->ht, data->nl);
+		appendStringInfo(&buf, ",\"typeoid\":%d", attr->atttypid);
 	}
-	else
+
+	col->prefix = buf.data;
+	col->prefixlen = buf.len;
+
+	initStringInfo(&buf);
+
+	/*
+	 * Print optional for columns. This information is redundant for
+	 * replica identity (index) because all attributes are not null.
+	 */
+	if (data->include_not_null)
 	{
-		appendStringInfo(&colnames, "],%s", data->nl);
-		if (data->include_types)
-			appendStringInfo(&coltypes, "],%s", data->nl);
-		if (data->include_type_oids)
-			appendStringInfo(&coltypeoids, "],%s", data->nl);
-		if (data->include_column_positions)
-			appendStringInfo(&colpositions, "],%s", data->nl);
-		if (data->include_not_null)
-			appendStringInfo(&colnotnulls, "],%s", data->nl);
-		if (data->include_default)
-			appendStringInfo(&coldefaults, "],%s", data->nl);
-		if (addcomma)
-			appendStringInfo(&colvalues, "],%s", data->nl);
+		if (attr->attnotnull)
+			appendStringInfoString(&buf, ",\"optional\":false");
 		else
-			appendStringInfo(&colvalues, "]%s", data->nl);
+			appendStringInfoString(&buf, ",\"optional\":true");
 	}
 
-	/* Print data */
-	appendStringInfoString(ctx->out, colnames.data);
-	if (data->include_types)
-		appendStringInfoString(ctx->out, coltypes.data);
-	if (data->include_type_oids)
-		appendStringInfoString(ctx->out, coltypeoids.data);
+	/*
+	 * Print position for columns. Positions are only available for new
+	 * tuple (INSERT, UPDATE).
+	 */
 	if (data->include_column_positions)
-		appendStringInfoString(ctx->out, colpositions.data);
-	if (data->include_not_null)
-		appendStringInfoString(ctx->out, colnotnulls.data);
-	if (data->include_default)
-		appendStringInfoString(ctx->out, coldefaults.data);
-	appendStringInfoString(ctx->out, colvalues.data);
+	{
+		appendStringInfo(&buf, ",\"position\":%d", attr->attnum);
+	}
 
-	pfree(colnames.data);
-	pfree(coltypes.data);
-	if (data->include_type_oids)
-		pfree(coltypeoids.data);
-	if (data->include_column_positions)
-		pfree(colpositions.data);
-	if (data->include_not_null)
-		pfree(colnotnulls.data);
-	if (data->include_default)
-		pfree(coldefaults.data);
-	pfree(colvalues.data);
-}
+	/*
+	 * Print default for columns.
+	 */
+	if (data->include_default && col->defval != NULL)
+	{
+		appendStringInfoString(&buf, ",\"default\":");
+		appendStringInfoString(&buf, col->defval);
+	}
 
-/* Print columns information */
-static void
-columns_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, bool addcomma, Relation relation)
-{
-	tuple_to_stringinfo(ctx, tupdesc, tuple, NULL, false, addcomma, relation);
-}
+	appendStringInfoChar(&buf, '}');
 
-/* Print replica identity information */
-static void
-identity_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, Bitmapset *bs)
-{
-	/* Last parameter does not matter */
-	tuple_to_stringinfo(ctx, tupdesc, tuple, bs, true, false, NULL);
+	col->suffix = buf.data;
+	col->suffixlen = buf.len;
 }
 
-/* Print primary key information */
+/*
+ * Format 1 writes the name, type, type oid, position, not null and default
+ * arrays. Domains are replaced by their base type if include-domain-data-type
+ * is set; the value is then written as the base type.
+ */
 static void
-pk_to_stringinfo(LogicalDecodingContext *ctx, TupleDesc tupdesc, HeapTuple tuple, Bitmapset *bs, bool addcomma)
+pg_build_column_v1(JsonDecodingData *data, Form_pg_attribute attr, JsonColumn *col)
 {
-	JsonDecodingData	*data;
-	int					natt;
-	char				comma[3] = "";
-
-	StringInfoData		pknames;
-	StringInfoData		pktypes;
-
-	data = ctx->output_plugin_private;
+	StringInfoData	buf;
+	Oid				typid = attr->atttypid;
 
-	initStringInfo(&pknames);
-	initStringInfo(&pktypes);
+	initStringInfo(&buf);
+	pg_escape_json(&buf, NameStr(attr->attname));
+	col->name = buf.data;
 
-	appendStringInfo(&pknames, "%s%s%s\"pk\":%s{%s", data->ht, data->ht, data->ht, data->sp, data->nl);
-	appendStringInfo(&pknames, "%s%s%s%s\"pknames\":%s[", data->ht, data->ht, data->ht, data->ht, data->sp);
-	appendStringInfo(&pktypes, "%s%s%s%s\"pktypes\":%s[", data->ht, data->ht, data->ht, data->ht, data->sp);
-
-	/* Print column information (name, type, value) */
-	for (natt = 0; natt < tupdesc->natts; natt++)
+	col->type = NULL;
+	if (data->include_types)
 	{
-		Form_pg_attribute	attr;		/* the attribute itself */
-		Oid					typid;		/* type of current attribute */
-		HeapTuple			type_tuple;	/* information about a type */
-
-		/*
-		 * Commit d34a74dd064af959acd9040446925d9d53dff15b introduced
-		 * TupleDescAttr() in back branches. If the version supports
-		 * this macro, use it. Version 10 and later already support it.
-		 */
-#if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
-		attr = tupdesc->attrs[natt];
-#else
-		attr = TupleDescAttr(tupdesc, natt);
-#endif
-
-		/* Do not print dropped or system columns */
-		if (attr->attisdropped || attr->attnum < 0)
-			continue;
-
-		/* Primary key column? */
-		if (bs != NULL && !bms_is_member(attr->attnum - FirstLowInvalidHeapAttributeNumber, bs))
-			continue;
-
-		typid = attr->atttypid;
+		HeapTuple		type_tuple;
+		Form_pg_type	type_form;
+		char			*type_str;
+		int				len;
 
-		/* Figure out type name */
 		type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
 		if (!HeapTupleIsValid(type_tuple))
 			elog(ERROR, "cache lookup failed for type %u", typid);
+		type_form = (Form_pg_type) GETSTRUCT(type_tuple);
 
-		/* Accumulate each column info */
-		appendStringInfo(&pknames, "%s", comma);
-		escape_json(&pknames, NameStr(attr->attname));
-
-		if (data->include_types)
+		/*
+		 * It is a domain. Replace domain name with base data type if
+		 * include_domain_data_type is enabled.
+		 */
+		if (type_form->typtype == TYPTYPE_DOMAIN && data->include_domain_data_type)
 		{
-			char	*type_str;
-			Form_pg_type type_form = (Form_pg_type) GETSTRUCT(type_tuple);
-
-			/*
-			 * It is a domain. Replace domain name with base data type if
-			 * include_domain_data_type is enabled.
-			 */
-			if (type_form->typtype == TYPTYPE_DOMAIN && data->include_domain_data_type)
-			{
-				typid = type_form->typbasetype;
-				if (data->include_typmod)
-				{
-					type_str = format_type_with_typemod(type_form->typbasetype, type_form->typtypmod);
-				}
-				else
-				{
-					/*
-					 * Since we are not using a format function, grab base type
-					 * name from Form_pg_type.
-					 */
-					type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
-					if (!HeapTupleIsValid(type_tuple))
-						elog(ERROR, "cache lookup failed for type %u", typid);
-					type_form = (Form_pg_type) GETSTRUCT(type_tuple);
-					type_str = pstrdup(NameStr(type_form->typname));
-				}
-			}
+			typid = type_form->typbasetype;
+			if (data->include_typmod)
+				type_str = format_type_with_typemod(type_form->typbasetype, type_form->typtypmod);
 			else
 			{
-				if (data->include_typmod)
-					type_str = TextDatumGetCString(DirectFunctionCall2(format_type, attr->atttypid, attr->atttypmod));
-				else
-					type_str = pstrdup(NameStr(type_form->typname));
-			}
+				HeapTuple	base_tuple;
 
-			appendStringInfo(&pktypes, "%s", comma);
-			/*
-			 * format_type() returns a quoted identifier, if
-			 * required. In this case, it doesn't need to enclose the type name
-			 * in double quotes.
-			 */
-			if (type_str[0] == '"')
-				appendStringInfo(&pktypes, "%s", type_str);
+				/*
+				 * Since we are not using a format function, grab base type
+				 * name from Form_pg_type.
+				 */
+				base_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+				if (!HeapTupleIsValid(base_tuple))
+					elog(ERROR, "cache lookup failed for type %u", typid);
+				type_str = pstrdup(NameStr(((Form_pg_type) GETSTRUCT(base_tuple))->typname));
+				ReleaseSysCache(base_tuple);
+			}
+		}
+		else
+		{
+			if (data->include_typmod)
+				type_str = TextDatumGetCString(DirectFunctionCall2(format_type, attr->atttypid, attr->atttypmod));
 			else
-				escape_json(&pktypes, type_str);
+				type_str = pstrdup(NameStr(type_form->typname));
+		}
+
+		ReleaseSysCache(type_tuple);
 
+		/*
+		 * format_type() returns a quoted identifier, if
+		 * required. In this case, it doesn't need to enclose the type name
+		 * in double quotes. However, if it is an array type, it should
+		 * escape it because the brackets are outside the double quotes.
+		 */
+		len = strlen(type_str);
+		if (type_str[0] == '"' && type_str[len - 1] != ']')
+			col->type = type_str;
+		else
+		{
+			initStringInfo(&buf);
+			pg_escape_json(&buf, type_str);
+			col->type = buf.data;
 			pfree(type_str);
 		}
+	}
 
-		ReleaseSysCache(type_tuple);
+	col->typeoid = psprintf("%u", typid);
+	col->position = psprintf("%d", attr->attnum);
+	col->notnull = attr->attnotnull;
+	col->kind = pg_value_kind(data, typid);
+	col->typid = typid;
+}
+
+/* Same as pg_json_value_kind() but types in type-encoders come first */
+static JsonValueKind
+pg_value_kind(JsonDecodingData *data, Oid typid)
+{
+	if (pg_find_type_encoder(data, typid) != NULL)
+		return JSON_VALUE_CUSTOM;
+	return pg_json_value_kind(typid);
+}
 
-		/* The first column does not have comma */
-		if (strcmp(comma, "") == 0)
-			snprintf(comma, 3, ",%s", data->sp);
+/* Classify a data type by how its values are written */
+static JsonValueKind
+pg_json_value_kind(Oid typid)
+{
+	switch (typid)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case OIDOID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+			return JSON_VALUE_NUMBER;
+		case BOOLOID:
+			return JSON_VALUE_BOOL;
+		case BYTEAOID:
+			return JSON_VALUE_BYTEA;
+		case TIMESTAMPOID:
+			return JSON_VALUE_TIMESTAMP;
+		case TIMESTAMPTZOID:
+			return JSON_VALUE_TIMESTAMPTZ;
+		case DATEOID:
+			return JSON_VALUE_DATE;
+		case TIMEOID:
+			return JSON_VALUE_TIME;
+		case UUIDOID:
+			return JSON_VALUE_UUID;
+		case JSONOID:
+			return JSON_VALUE_JSON;
+		case JSONBOID:
+			return JSON_VALUE_JSONB;
+		default:
+			if (type_is_enum(typid))
+				return JSON_VALUE_ENUM;
+			if (type_is_range(typid))
+				return JSON_VALUE_RANGE;
+			if (type_is_rowtype(typid))
+				return JSON_VALUE_COMPOSITE;
+			if (OidIsValid(get_element_type(typid)))
+				return JSON_VALUE_ARRAY;
+			if (OidIsValid(pg_hstore_to_json(typid)))
+				return JSON_VALUE_HSTORE;
+			return JSON_VALUE_STRING;
 	}
+}
 
-	appendStringInfo(&pknames, "],%s", data->nl);
-	appendStringInfo(&pktypes, "]%s", data->nl);
-	if (addcomma)
-		appendStringInfo(&pktypes, "%s%s%s},%s", data->ht, data->ht, data->ht, data->nl);
-	else
-		appendStringInfo(&pktypes, "%s%s%s}%s", data->ht, data->ht, data->ht, data->nl);
+/*
+ * hstore is an extension hence it has no fixed OID. Returns the OID of
+ * hstore_to_json() from the type's schema if typid is hstore.
+ */
+static Oid
+pg_hstore_to_json(Oid typid)
+{
+	HeapTuple	tup;
+	Form_pg_type typform;
+	char		*nspname;
+	Oid			funcid = InvalidOid;
 
-	appendStringInfoString(ctx->out, pknames.data);
-	appendStringInfoString(ctx->out, pktypes.data);
+	tup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+	if (!HeapTupleIsValid(tup))
+		return InvalidOid;
+	typform = (Form_pg_type) GETSTRUCT(tup);
 
-	pfree(pknames.data);
-	pfree(pktypes.data);
+	if (strcmp(NameStr(typform->typname), "hstore") == 0)
+	{
+		nspname = get_namespace_name(typform->typnamespace);
+		funcid = LookupFuncName(list_make2(makeString(nspname), makeString("hstore_to_json")),
+								1, &typid, true);
+	}
+
+	ReleaseSysCache(tup);
+
+	return funcid;
 }
 
-static bool
-pg_filter_by_action(int change_type, JsonAction actions)
+static void
+pg_decode_write_value(LogicalDecodingContext *ctx, JsonColumn *col, Datum value, bool isnull, bool elide)
 {
-	if (change_type == REORDER_BUFFER_CHANGE_INSERT && !actions.insert)
+	JsonDecodingData	*data;
+
+	data = ctx->output_plugin_private;
+
+	if (isnull)
 	{
-		elog(DEBUG3, "ignore INSERT");
-		return true;
+		appendStringInfoString(ctx->out, "null");
+		return;
 	}
-	if (change_type == REORDER_BUFFER_CHANGE_UPDATE && !actions.update)
+
+	/* XXX dead code? check is one level above. */
+	if (col->isvarlena && VARATT_IS_EXTERNAL_ONDISK(value))
 	{
-		elog(DEBUG3, "ignore UPDATE");
-		return true;
+		elog(DEBUG1, "unchanged TOAST Datum");
+		return;
 	}
-	if (change_type == REORDER_BUFFER_CHANGE_DELETE && !actions.delete)
+
+	if (elide && pg_elide_value(data, col, value))
 	{
-		elog(DEBUG3, "ignore DELETE");
-		return true;
+		pg_append_elided(ctx->out, col, value);
+		return;
 	}
 
-	return false;
+	pg_check_type_cache(data);
+	pg_encode_value(data, ctx->out, col->typid, col->kind, &col->outfunc, col->isvarlena, value);
 }
 
+/*
+ * Is this value written as elided? The size of a varlena is read from its
+ * header, it is not detoasted.
+ */
 static bool
-pg_filter_by_table(List *filter_tables, char *schemaname, char *tablename)
+pg_elide_value(JsonDecodingData *data, JsonColumn *col, Datum value)
 {
-	if (list_length(filter_tables) > 0)
+	return col->elide || (data->max_value_size > 0 && col->isvarlena &&
+						  pg_varlena_data_size(value) > data->max_value_size);
+}
+
+/*
+ * Size of the detoasted data without its header. It is read from the header
+ * hence external or compressed values are not fetched.
+ */
+static Size
+pg_varlena_data_size(Datum value)
+{
+	struct varlena *ptr = (struct varlena *) DatumGetPointer(value);
+
+	if (!VARATT_IS_EXTERNAL(ptr) && VARATT_IS_SHORT(ptr))
+		return toast_raw_datum_size(value) - VARHDRSZ_SHORT;
+	return toast_raw_datum_size(value) - VARHDRSZ;
+}
+
+/*
+ * Write {"elided":true,"size":...,"hash":...} instead of the value. size is
+ * the data size in bytes. hash is computed from the bytes as they are stored
+ * (maybe compressed) hence it changes when the value changes but equal values
+ * stored differently have different hashes.
+ */
+static void
+pg_append_elided(StringInfo buf, JsonColumn *col, Datum value)
+{
+	Size		size;
+	uint32		hash;
+
+	if (col->isvarlena)
 	{
-		ListCell	*lc;
+		struct varlena *ptr = (struct varlena *) DatumGetPointer(value);
 
-		foreach(lc, filter_tables)
+		size = pg_varlena_data_size(value);
+
+		/* decoded TOAST values are pointers to the reassembled value */
+		if (VARATT_IS_EXTERNAL_INDIRECT(ptr))
 		{
-			SelectTable	*t = lfirst(lc);
+			struct varatt_indirect redirect;
 
-			if (t->allschemas || strcmp(t->schemaname, schemaname) == 0)
-			{
-				if (t->alltables || strcmp(t->tablename, tablename) == 0)
-				{
-					elog(DEBUG2, "\"%s\".\"%s\" was filtered out",
-								((t->allschemas) ? "*" : t->schemaname),
-								((t->alltables) ? "*" : t->tablename));
-					return true;
+			VARATT_EXTERNAL_GET_POINTER(redirect, ptr);
+			ptr = (struct varlena *) redirect.pointer;
+		}
+		hash = DatumGetUInt32(hash_any((unsigned char *) ptr, VARSIZE_ANY(ptr)));
+	}
+	else if (col->typbyval)
+	{
+		size = col->typlen;
+		hash = DatumGetUInt32(hash_any((unsigned char *) &value, sizeof(Datum)));
+	}
+	else
+	{
+		size = datumGetSize(value, col->typbyval, col->typlen);
+		hash = DatumGetUInt32(hash_any((unsigned char *) DatumGetPointer(value), size));
+	}
+
+	appendStringInfo(buf, "{\"elided\":true,\"size\":" UINT64_FORMAT ",\"hash\":%u}",
+					 (uint64) size, hash);
+}
+
+/* Write a value that is not null */
+static void
+pg_encode_value(JsonDecodingData *data, StringInfo buf, Oid typid, JsonValueKind kind, FmgrInfo *outfunc, bool isvarlena, Datum value)
+{
+	char		*outstr;
+
+	/* if value is varlena, detoast Datum */
+	if (isvarlena)
+		value = PointerGetDatum(PG_DETOAST_DATUM(value));
+
+	if (kind >= JSON_VALUE_TIMESTAMP && pg_encode_builtin(data, buf, typid, kind, value))
+		return;
+
+	outstr = OutputFunctionCall(outfunc, value);
+
+	/*
+	 * Data types are printed with quotes unless they are number, true, false,
+	 * null, an array or an object.
+	 *
+	 * The NaN an Infinity are not valid JSON symbols. Hence, regardless of
+	 * sign they are represented as the string null.
+	 *
+	 * Exception to this is when data->numeric_data_types_as_string is
+	 * true. In this case, numbers (including NaN and Infinity values)
+	 * are printed with quotes.
+	 */
+	switch (kind)
+	{
+		case JSON_VALUE_NUMBER:
+			if (data->numeric_data_types_as_string) {
+				if (strspn(outstr, "0123456789+-eE.") == strlen(outstr) ||
+						pg_strncasecmp(outstr, "NaN", 3) == 0 ||
+						pg_strncasecmp(outstr, "Infinity", 8) == 0 ||
+						pg_strncasecmp(outstr, "-Infinity", 9) == 0) {
+					pg_escape_json(buf, outstr);
+				} else {
+					elog(ERROR, "%s is not a number", outstr);
 				}
 			}
-		}
-	}
-
-	return false;
-}
-
-static bool
-pg_add_by_table(List *add_tables, char *schemaname, char *tablename)
-{
-	if (list_length(add_tables) > 0)
-	{
-		ListCell	*lc;
-
-		/* all tables in all schemas are added by default */
-		foreach(lc, add_tables)
-		{
-			SelectTable	*t = lfirst(lc);
-
-			if (t->allschemas || strcmp(t->schemaname, schemaname) == 0)
+			else if (pg_strncasecmp(outstr, "NaN", 3) == 0 ||
+					pg_strncasecmp(outstr, "Infinity", 8) == 0 ||
+					pg_strncasecmp(outstr, "-Infinity", 9) == 0)
 			{
-				if (t->alltables || strcmp(t->tablename, tablename) == 0)
-				{
-					elog(DEBUG2, "\"%s\".\"%s\" was added",
-								((t->allschemas) ? "*" : t->schemaname),
-								((t->alltables) ? "*" : t->tablename));
-					return true;
-				}
+				appendStringInfoString(buf, "null");
+				elog(DEBUG1, "special value: %s", outstr);
 			}
-		}
+			else if (strspn(outstr, "0123456789+-eE.") == strlen(outstr))
+				appendStringInfo(buf, "%s", outstr);
+			else
+				elog(ERROR, "%s is not a number", outstr);
+			break;
+		case JSON_VALUE_BOOL:
+			if (strcmp(outstr, "t") == 0)
+				appendStringInfoString(buf, "true");
+			else
+				appendStringInfoString(buf, "false");
+			break;
+		case JSON_VALUE_BYTEA:
+			/* string is "\x54617069727573", start after \x */
+			pg_escape_json(buf, (outstr + 2));
+			break;
+		case JSON_VALUE_STRING:
+		case JSON_VALUE_TIMESTAMP:
+		case JSON_VALUE_TIMESTAMPTZ:
+		case JSON_VALUE_DATE:
+		case JSON_VALUE_TIME:
+		case JSON_VALUE_UUID:
+		case JSON_VALUE_ENUM:
+		case JSON_VALUE_JSON:
+		case JSON_VALUE_JSONB:
+		case JSON_VALUE_ARRAY:
+		case JSON_VALUE_COMPOSITE:
+		case JSON_VALUE_RANGE:
+		case JSON_VALUE_HSTORE:
+		case JSON_VALUE_CUSTOM:
+			pg_escape_json(buf, outstr);
+			break;
 	}
 
-	return false;
+	pfree(outstr);
 }
 
-/* Callback for individual changed tuples */
 static void
-pg_decode_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
-				 Relation relation, ReorderBufferChange *change)
+pg_decode_write_tuple(LogicalDecodingContext *ctx, Relation relation, JsonTuple *jt, PGOutputJsonKind kind)
 {
-	JsonDecodingData *data = ctx->output_plugin_private;
-
-#if PG_VERSION_NUM >= 150000 && PG_VERSION_NUM < 160000
-	update_replication_progress(ctx, false);
-#elif PG_VERSION_NUM >= 140004 && PG_VERSION_NUM < 150000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 130008 && PG_VERSION_NUM < 140000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 120012 && PG_VERSION_NUM < 130000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 110017 && PG_VERSION_NUM < 120000
-	update_replication_progress(ctx);
-#elif PG_VERSION_NUM >= 100022 && PG_VERSION_NUM < 110000
-	update_replication_progress(ctx);
-#endif
+	JsonDecodingData	*data;
+	JsonRelationEntry	*entry;
+	int					i;
+	bool				need_sep = false;
 
-	if (data->format_version == 2)
-		pg_decode_change_v2(ctx, txn, relation, change);
-	else if (data->format_version == 1)
-		pg_decode_change_v1(ctx, txn, relation, change);
-	else
-		elog(ERROR, "format version %d is not supported", data->format_version);
-}
+	data = ctx->output_plugin_private;
 
-static void
-pg_decode_change_v1(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
-				 Relation relation, ReorderBufferChange *change)
-{
-	JsonDecodingData *data;
-	Form_pg_class class_form;
-	TupleDesc	tupdesc;
-	MemoryContext old;
+	entry = get_column_plan(data, relation);
 
-	Bitmapset	*pkbs = NULL;
-	Bitmapset	*ribs = NULL;
+	/* Break down the tuple into fields */
+	pg_json_tuple_fetch(jt, RelationGetDescr(relation), entry,
+						kind != PGOUTPUTJSON_CHANGE, kind == PGOUTPUTJSON_IDENTITY);
 
-	char		*schemaname;
-	char		*tablename;
+	for (i = 0; i < entry->ncolumns; i++)
+	{
+		JsonColumn	*col = &entry->columns[i];
+		int			j = col->attidx;
 
-	AssertVariableIsOfType(&pg_decode_change, LogicalDecodeChangeCB);
+		if (kind == PGOUTPUTJSON_IDENTITY && !col->identity)
+			continue;
+		if (kind == PGOUTPUTJSON_PK && !col->pk)
+			continue;
 
-	data = ctx->output_plugin_private;
+		/* don't send unchanged TOAST Datum */
+		if (!jt->nulls[j] && col->isvarlena && VARATT_IS_EXTERNAL_ONDISK(jt->values[j]))
+			continue;
 
-	/* filter changes by action */
-	if (pg_filter_by_action(change->action, data->actions))
-		return;
+		if (need_sep)
+			appendStringInfoChar(ctx->out, ',');
+		need_sep = true;
 
-	class_form = RelationGetForm(relation);
-	tupdesc = RelationGetDescr(relation);
+		appendBinaryStringInfo(ctx->out, col->prefix, col->prefixlen);
 
-	/* Avoid leaking memory by using and resetting our own context */
-	old = MemoryContextSwitchTo(data->context);
+		if (kind != PGOUTPUTJSON_PK)
+		{
+			appendStringInfoString(ctx->out, ",\"value\":");
+			pg_json_tuple_write_value(ctx, jt, col, kind == PGOUTPUTJSON_IDENTITY);
+		}
 
-	/* schema and table names are used for select tables */
-	schemaname = get_namespace_name(class_form->relnamespace);
-	tablename = NameStr(class_form->relname);
+		if (kind == PGOUTPUTJSON_CHANGE)
+			appendBinaryStringInfo(ctx->out, col->suffix, col->suffixlen);
+		else
+			appendStringInfoChar(ctx->out, '}');
+	}
+}
 
-	if (data->write_in_chunks)
-		OutputPluginPrepareWrite(ctx, true);
+static void
+pg_decode_write_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, Relation relation, ReorderBufferChange *change)
+{
+	JsonDecodingData *data = ctx->output_plugin_private;
+	JsonRelationEntry *entry;
+	JsonTuple	newtuple;
+	JsonTuple	oldtuple;
+	int			start;
 
-	/* Make sure rd_replidindex is set */
+	/* make sure rd_pkindex and rd_replidindex are set */
 	RelationGetIndexList(relation);
 
-	/* Filter tables, if available */
-	if (pg_filter_by_table(data->filter_tables, schemaname, tablename))
-	{
-		MemoryContextSwitchTo(old);
-		MemoryContextReset(data->context);
-		return;
-	}
-
-	/* Add tables */
-	if (!pg_add_by_table(data->add_tables, schemaname, tablename))
-	{
-		MemoryContextSwitchTo(old);
-		MemoryContextReset(data->context);
-		return;
-	}
-
 	switch (change->action)
 	{
 		case REORDER_BUFFER_CHANGE_INSERT:
 			if (change->data.tp.newtuple == NULL)
 			{
-				elog(WARNING, "no tuple data for INSERT in table \"%s\"", NameStr(class_form->relname));
-				MemoryContextSwitchTo(old);
-				MemoryContextReset(data->context);
+				elog(WARNING, "no tuple data for INSERT in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
 				return;
 			}
-			break;
-		case REORDER_BUFFER_CHANGE_UPDATE:
-			/*
-			 * Bail out iif:
-			 * (i) doesn't have a pk and replica identity is not full;
-			 * (ii) replica identity is nothing.
-			 */
-			if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+			/* keys-only prints nothing but the replica identity */
+			if (data->keys_only && !OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
 			{
-				/* FIXME this sentence is imprecise */
-				elog(WARNING, "table \"%s\" without primary key or replica identity is nothing", NameStr(class_form->relname));
-				MemoryContextSwitchTo(old);
-				MemoryContextReset(data->context);
+				elog(WARNING, "no tuple identifier for INSERT in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
 				return;
 			}
-
+			break;
+		case REORDER_BUFFER_CHANGE_UPDATE:
 			if (change->data.tp.newtuple == NULL)
 			{
-				elog(WARNING, "no tuple data for UPDATE in table \"%s\"", NameStr(class_form->relname));
-				MemoryContextSwitchTo(old);
-				MemoryContextReset(data->context);
+				elog(WARNING, "no tuple data for UPDATE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
 				return;
 			}
-			break;
-		case REORDER_BUFFER_CHANGE_DELETE:
-			/*
-			 * Bail out iif:
-			 * (i) doesn't have a pk and replica identity is not full;
-			 * (ii) replica identity is nothing.
-			 */
-			if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+			if (change->data.tp.oldtuple == NULL)
 			{
-				/* FIXME this sentence is imprecise */
-				elog(WARNING, "table \"%s\" without primary key or replica identity is nothing", NameStr(class_form->relname));
-				MemoryContextSwitchTo(old);
-				MemoryContextReset(data->context);
-				return;
+				if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+				{
+					elog(WARNING, "no tuple identifier for UPDATE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
+					return;
+				}
 			}
-
+			break;
+		case REORDER_BUFFER_CHANGE_DELETE:
 			if (change->data.tp.oldtuple == NULL)
 			{
-				elog(WARNING, "no tuple data for DELETE in table \"%s\"", NameStr(class_form->relname));
-				MemoryContextSwitchTo(old);
-				MemoryContextReset(data->context);
-				return;
+				if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+				{
+					elog(WARNING, "no tuple identifier for DELETE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
+					return;
+				}
 			}
 			break;
 		default:
 			Assert(false);
 	}
 
-	/* Change counter */
-	data->nr_changes++;
-
-	/* if we don't write in chunks, we need a newline here */
-	if (!data->write_in_chunks)
-		appendStringInfo(ctx->out, "%s", data->nl);
+	/* tuples are deformed once for all sections */
+#if PG_VERSION_NUM >= 170000
+	pg_json_tuple_init(&newtuple, change->data.tp.newtuple);
+	pg_json_tuple_init(&oldtuple, change->data.tp.oldtuple);
+#else
+	pg_json_tuple_init(&newtuple, change->data.tp.newtuple ? &change->data.tp.newtuple->tuple : NULL);
+	pg_json_tuple_init(&oldtuple, change->data.tp.oldtuple ? &change->data.tp.oldtuple->tuple : NULL);
+#endif
 
-	appendStringInfo(ctx->out, "%s%s", data->ht, data->ht);
+	OutputPluginPrepareWrite(ctx, true);
 
-	if (data->nr_changes > 1)
-		appendStringInfoChar(ctx->out, ',');
+	entry = get_relation_entry(data, relation);
+	start = pg_reserve_output(data, entry, ctx->out);
 
-	appendStringInfo(ctx->out, "{%s", data->nl);
+	appendStringInfoChar(ctx->out, '{');
 
-	/* Print change kind */
 	switch (change->action)
 	{
 		case REORDER_BUFFER_CHANGE_INSERT:
-			appendStringInfo(ctx->out, "%s%s%s\"kind\":%s\"insert\",%s", data->ht, data->ht, data->ht, data->sp, data->nl);
+			appendStringInfoString(ctx->out, "\"action\":\"I\"");
 			break;
 		case REORDER_BUFFER_CHANGE_UPDATE:
-			appendStringInfo(ctx->out, "%s%s%s\"kind\":%s\"update\",%s", data->ht, data->ht, data->ht, data->sp, data->nl);
+			appendStringInfoString(ctx->out, "\"action\":\"U\"");
 			break;
 		case REORDER_BUFFER_CHANGE_DELETE:
-			appendStringInfo(ctx->out, "%s%s%s\"kind\":%s\"delete\",%s", data->ht, data->ht, data->ht, data->sp, data->nl);
+			appendStringInfoString(ctx->out, "\"action\":\"D\"");
 			break;
 		default:
 			Assert(false);
 	}
 
-	/* Print table name (possibly) qualified */
-	if (data->include_schemas)
+	pg_append_txn_fragment(ctx, txn);
+
+	if (data->include_lsn)
 	{
-		appendStringInfo(ctx->out, "%s%s%s\"schema\":%s", data->ht, data->ht, data->ht, data->sp);
-		escape_json(ctx->out, get_namespace_name(class_form->relnamespace));
-		appendStringInfo(ctx->out, ",%s", data->nl);
+		appendStringInfoString(ctx->out, ",\"lsn\":");
+		pg_append_lsn(data, ctx->out, change->lsn);
 	}
-	appendStringInfo(ctx->out, "%s%s%s\"table\":%s", data->ht, data->ht, data->ht, data->sp);
-	escape_json(ctx->out, NameStr(class_form->relname));
-	appendStringInfo(ctx->out, ",%s", data->nl);
 
-	if (data->include_pk)
-#if PG_VERSION_NUM >= 100000
-		pkbs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_PRIMARY_KEY);
-#else
-		pkbs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_KEY);
-#endif
+	appendBinaryStringInfo(ctx->out, entry->names, entry->nameslen);
 
-	switch (change->action)
+	/*
+	 * print new tuple (INSERT, UPDATE). keys-only prints only its replica
+	 * identity columns.
+	 */
+	if (change->data.tp.newtuple != NULL)
 	{
-		case REORDER_BUFFER_CHANGE_INSERT:
-			/* Print the new tuple */
-#if	PG_VERSION_NUM >= 100000
-			if (data->include_pk && OidIsValid(relation->rd_pkindex))
-#else
-			if (data->include_pk && OidIsValid(relation->rd_replidindex) &&
-					relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
-#endif
-			{
-#if	PG_VERSION_NUM >= 170000
-				columns_to_stringinfo(ctx, tupdesc, change->data.tp.newtuple, true, relation);
-				pk_to_stringinfo(ctx, tupdesc, change->data.tp.newtuple, pkbs, false);
-#else
-				columns_to_stringinfo(ctx, tupdesc, &change->data.tp.newtuple->tuple, true, relation);
-				pk_to_stringinfo(ctx, tupdesc, &change->data.tp.newtuple->tuple, pkbs, false);
-#endif
-			}
-			else
-			{
-#if	PG_VERSION_NUM >= 170000
-				columns_to_stringinfo(ctx, tupdesc, change->data.tp.newtuple, false, relation);
-#else
-				columns_to_stringinfo(ctx, tupdesc, &change->data.tp.newtuple->tuple, false, relation);
-#endif
-			}
-			break;
-		case REORDER_BUFFER_CHANGE_UPDATE:
-			/* Print the new tuple */
-#if	PG_VERSION_NUM >= 170000
-			columns_to_stringinfo(ctx, tupdesc, change->data.tp.newtuple, true, relation);
-#else
-			columns_to_stringinfo(ctx, tupdesc, &change->data.tp.newtuple->tuple, true, relation);
-#endif
+		PGOutputJsonKind	kind = data->keys_only ? PGOUTPUTJSON_IDENTITY : PGOUTPUTJSON_CHANGE;
 
-#if	PG_VERSION_NUM >= 100000
-			if (data->include_pk && OidIsValid(relation->rd_pkindex))
-#else
-			if (data->include_pk && OidIsValid(relation->rd_replidindex) &&
-					relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
-#endif
-			{
-#if	PG_VERSION_NUM >= 170000
-				pk_to_stringinfo(ctx, tupdesc, change->data.tp.newtuple, pkbs, true);
-#else
-				pk_to_stringinfo(ctx, tupdesc, &change->data.tp.newtuple->tuple, pkbs, true);
-#endif
-			}
+		appendStringInfoString(ctx->out, ",\"columns\":[");
+		pg_decode_write_tuple(ctx, relation, &newtuple, kind);
+		appendStringInfoChar(ctx->out, ']');
+	}
+
+	/*
+	 * Print old tuple (UPDATE, DELETE)
+	 *
+	 * old tuple is available when:
+	 * (1) primary key changes;
+	 * (2) replica identity is index and one of the indexed columns changes;
+	 * (3) replica identity is full.
+	 *
+	 * If old tuple is not available (because (a) primary key does not change
+	 * or (b) replica identity is index and none of indexed columns does not
+	 * change) identity is obtained from new tuple (because it doesn't change).
+	 *
+	 */
+	if (change->data.tp.oldtuple != NULL)
+	{
+		appendStringInfoString(ctx->out, ",\"identity\":[");
+		pg_decode_write_tuple(ctx, relation, &oldtuple, PGOUTPUTJSON_IDENTITY);
+		appendStringInfoChar(ctx->out, ']');
+	}
+	else
+	{
+		/*
+		 * Old tuple is not available, however, identity can be obtained from
+		 * new tuple (because it doesn't change).
+		 */
+		/* keys-only: identity did not change and it is already in columns */
+		if (change->action == REORDER_BUFFER_CHANGE_UPDATE && !data->keys_only)
+		{
+			elog(DEBUG2, "old tuple is null on UPDATE");
 
 			/*
-			 * The old tuple is available when:
-			 * (i) pk changes;
-			 * (ii) replica identity is full;
-			 * (iii) replica identity is index and indexed column changes.
-			 *
-			 * FIXME if old tuple is not available we must get only the indexed
-			 * columns (the whole tuple is printed).
+			 * Before v10, there is not rd_pkindex then rely on REPLICA
+			 * IDENTITY DEFAULT to obtain primary key.
 			 */
-			if (change->data.tp.oldtuple == NULL)
-			{
-				elog(DEBUG1, "old tuple is null");
-
-				ribs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_IDENTITY_KEY);
-#if	PG_VERSION_NUM >= 170000
-				identity_to_stringinfo(ctx, tupdesc, change->data.tp.newtuple, ribs);
+#if PG_VERSION_NUM >= 100000
+			if (OidIsValid(relation->rd_pkindex) || OidIsValid(relation->rd_replidindex))
 #else
-				identity_to_stringinfo(ctx, tupdesc, &change->data.tp.newtuple->tuple, ribs);
+			if (OidIsValid(relation->rd_replidindex))
 #endif
-			}
-			else
 			{
-				elog(DEBUG1, "old tuple is not null");
-#if	PG_VERSION_NUM >= 170000
-				identity_to_stringinfo(ctx, tupdesc, change->data.tp.oldtuple, NULL);
-#else
-				identity_to_stringinfo(ctx, tupdesc, &change->data.tp.oldtuple->tuple, NULL);
-#endif
+				elog(DEBUG1, "REPLICA IDENTITY: obtain old tuple using new tuple");
+				appendStringInfoString(ctx->out, ",\"identity\":[");
+				pg_decode_write_tuple(ctx, relation, &newtuple, PGOUTPUTJSON_IDENTITY);
+				appendStringInfoChar(ctx->out, ']');
 			}
-			break;
-		case REORDER_BUFFER_CHANGE_DELETE:
-#if	PG_VERSION_NUM >= 100000
-			if (data->include_pk && OidIsValid(relation->rd_pkindex))
-#else
-			if (data->include_pk && OidIsValid(relation->rd_replidindex) &&
-					relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
-#endif
+			else
 			{
-#if	PG_VERSION_NUM >= 170000
-				pk_to_stringinfo(ctx, tupdesc, change->data.tp.oldtuple, pkbs, true);
-#else
-				pk_to_stringinfo(ctx, tupdesc, &change->data.tp.oldtuple->tuple, pkbs, true);
-#endif
+				/* old tuple is not available and can't be obtained, report it */
+				elog(WARNING, "no old tuple data for UPDATE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
 			}
+		}
+
+		/* old tuple is not available and can't be obtained, report it */
+		if (change->action == REORDER_BUFFER_CHANGE_DELETE)
+		{
+			elog(WARNING, "no old tuple data for DELETE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
+		}
+	}
 
-			ribs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_IDENTITY_KEY);
-#if	PG_VERSION_NUM >= 170000
-			identity_to_stringinfo(ctx, tupdesc, change->data.tp.oldtuple, ribs);
+	if (data->include_pk)
+	{
+		appendStringInfoString(ctx->out, ",\"pk\":[");
+#if PG_VERSION_NUM >= 100000
+		if (OidIsValid(relation->rd_pkindex))
 #else
-			identity_to_stringinfo(ctx, tupdesc, &change->data.tp.oldtuple->tuple, ribs);
+		if (OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
 #endif
-
-			if (change->data.tp.oldtuple == NULL)
-				elog(DEBUG1, "old tuple is null");
+		{
+			if (change->data.tp.oldtuple != NULL)
+				pg_decode_write_tuple(ctx, relation, &oldtuple, PGOUTPUTJSON_PK);
 			else
-				elog(DEBUG1, "old tuple is not null");
-			break;
-		default:
-			Assert(false);
+				pg_decode_write_tuple(ctx, relation, &newtuple, PGOUTPUTJSON_PK);
+		}
+		appendStringInfoChar(ctx->out, ']');
 	}
 
-	bms_free(pkbs);
-	bms_free(ribs);
-
-	appendStringInfo(ctx->out, "%s%s}", data->ht, data->ht);
+	appendStringInfoChar(ctx->out, '}');
 
-	MemoryContextSwitchTo(old);
-	MemoryContextReset(data->context);
+	pg_account_output(data, entry, ctx->out, start);
 
-	if (data->write_in_chunks)
-		OutputPluginWrite(ctx, true);
+	OutputPluginWrite(ctx, true);
 }
 
 static void
-pg_decode_write_value(LogicalDecodingContext *ctx, Datum value, bool isnull, Oid typid)
+pg_decode_change_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+				 Relation relation, ReorderBufferChange *change)
 {
-	JsonDecodingData	*data;
-	Oid					typoutfunc;
-	bool				isvarlena;
-	char				*outstr;
+	JsonDecodingData *data = ctx->output_plugin_private;
+	JsonRelationEntry *entry;
+	ReorderBufferChange routed;
+	int			action;
+	MemoryContext old;
 
-	data = ctx->output_plugin_private;
+	/* avoid leaking memory by using and resetting our own context */
+	old = MemoryContextSwitchTo(data->context);
 
-	if (isnull)
+	/* table filters and actions are evaluated once per relation */
+	entry = get_relation_entry(data, relation);
+
+	/* filter changes by action, table and shard */
+	if (pg_filter_by_action(change->action, entry->actions) || !entry->selected ||
+		(data->shard_count > 1 && pg_filter_by_shard(data, entry, RelationGetDescr(relation), change, &action)))
 	{
-		appendStringInfoString(ctx->out, "null");
+		MemoryContextSwitchTo(old);
+		MemoryContextReset(data->context);
 		return;
 	}
 
-	/* get type information and call its output function */
-	getTypeOutputInfo(typid, &typoutfunc, &isvarlena);
-
-	/* XXX dead code? check is one level above. */
-	if (isvarlena && VARATT_IS_EXTERNAL_ONDISK(value))
+	/* the row moved to or from this shard */
+	if (data->shard_count > 1 && action != change->action)
 	{
-		elog(DEBUG1, "unchanged TOAST Datum");
-		return;
+		routed = *change;
+		pg_shard_route_change(&routed, action);
+		change = &routed;
 	}
 
-	/* if value is varlena, detoast Datum */
-	if (isvarlena)
+	if (data->summary)
 	{
-		Datum	detoastedval;
-
-		detoastedval = PointerGetDatum(PG_DETOAST_DATUM(value));
-		outstr = OidOutputFunctionCall(typoutfunc, detoastedval);
+		switch (change->action)
+		{
+			case REORDER_BUFFER_CHANGE_INSERT:
+				pg_summary_count(data, relation, 0);
+				break;
+			case REORDER_BUFFER_CHANGE_UPDATE:
+				pg_summary_count(data, relation, 1);
+				break;
+			case REORDER_BUFFER_CHANGE_DELETE:
+				pg_summary_count(data, relation, 2);
+				break;
+			default:
+				Assert(false);
+		}
 	}
+	else if (data->compact_changes && data->compact_state->active)
+		pg_compact_change(ctx, txn, relation, change);
 	else
+		pg_decode_write_change(ctx, txn, relation, change);
+
+	MemoryContextSwitchTo(old);
+	MemoryContextReset(data->context);
+}
+
+/*
+ * Count a change for summary. Table names are looked up once per table and
+ * transaction.
+ */
+static void
+pg_summary_count(JsonDecodingData *data, Relation relation, int idx)
+{
+	JsonSummaryState	*ss = data->summary_state;
+	JsonSummaryEntry	*entry;
+	Oid					relid = RelationGetRelid(relation);
+	bool				found;
+
+	if (ss->hash == NULL)
 	{
-		outstr = OidOutputFunctionCall(typoutfunc, value);
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(JsonSummaryEntry);
+		ctl.hcxt = ss->context;
+#if PG_VERSION_NUM >= 90500
+		ss->hash = hash_create("wal2json summary", 32, &ctl,
+								HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+#else
+		ctl.hash = oid_hash;
+		ss->hash = hash_create("wal2json summary", 32, &ctl,
+								HASH_ELEM | HASH_FUNCTION | HASH_CONTEXT);
+#endif
 	}
 
-	/*
-	 * Data types are printed with quotes unless they are number, true, false,
-	 * null, an array or an object.
-	 *
-	 * The NaN an Infinity are not valid JSON symbols. Hence, regardless of
-	 * sign they are represented as the string null.
-	 *
-	 * Exception to this is when data->numeric_data_types_as_string is
-	 * true. In this case, numbers (including NaN and Infinity values)
-	 * are printed with quotes.
-	 */
-	switch (typid)
+	entry = (JsonSummaryEntry *) hash_search(ss->hash, (void *) &relid, HASH_ENTER, &found);
+	if (!found)
 	{
-		case INT2OID:
-		case INT4OID:
-		case INT8OID:
-		case OIDOID:
-		case FLOAT4OID:
-		case FLOAT8OID:
-		case NUMERICOID:
-			if (data->numeric_data_types_as_string) {
-				if (strspn(outstr, "0123456789+-eE.") == strlen(outstr) ||
-						pg_strncasecmp(outstr, "NaN", 3) == 0 ||
-						pg_strncasecmp(outstr, "Infinity", 8) == 0 ||
-						pg_strncasecmp(outstr, "-Infinity", 9) == 0) {
-					escape_json(ctx->out, outstr);
-				} else {
-					elog(ERROR, "%s is not a number", outstr);
-				}
-			}
-			else if (pg_strncasecmp(outstr, "NaN", 3) == 0 ||
-					pg_strncasecmp(outstr, "Infinity", 8) == 0 ||
-					pg_strncasecmp(outstr, "-Infinity", 9) == 0)
+		MemoryContext	old = MemoryContextSwitchTo(ss->context);
+
+		ListCell		*lc;
+
+		if (data->include_schemas)
+			entry->name = psprintf("%s.%s", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
+		else
+			entry->name = pstrdup(RelationGetRelationName(relation));
+		memset(entry->count, 0, sizeof(entry->count));
+		entry->counts = entry;
+
+		/* without schemas, tables with the same name share one key */
+		if (!data->include_schemas)
+		{
+			foreach(lc, ss->tables)
 			{
-				appendStringInfoString(ctx->out, "null");
-				elog(DEBUG1, "special value: %s", outstr);
+				JsonSummaryEntry	*other = (JsonSummaryEntry *) lfirst(lc);
+
+				if (strcmp(other->name, entry->name) == 0)
+				{
+					entry->counts = other;
+					break;
+				}
 			}
-			else if (strspn(outstr, "0123456789+-eE.") == strlen(outstr))
-				appendStringInfo(ctx->out, "%s", outstr);
-			else
-				elog(ERROR, "%s is not a number", outstr);
-			break;
-		case BOOLOID:
-			if (strcmp(outstr, "t") == 0)
-				appendStringInfoString(ctx->out, "true");
-			else
-				appendStringInfoString(ctx->out, "false");
-			break;
-		case BYTEAOID:
-			/* string is "\x54617069727573", start after \x */
-			escape_json(ctx->out, (outstr + 2));
-			break;
-		default:
-			escape_json(ctx->out, outstr);
-			break;
+		}
+		if (entry->counts == entry)
+			ss->tables = lappend(ss->tables, entry);
+
+		MemoryContextSwitchTo(old);
 	}
 
-	pfree(outstr);
+	entry->counts->count[idx]++;
 }
 
+/* Output the summary object of a transaction */
 static void
-pg_decode_write_tuple(LogicalDecodingContext *ctx, Relation relation, HeapTuple tuple, PGOutputJsonKind kind)
+pg_decode_write_summary(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, XLogRecPtr commit_lsn)
 {
-	JsonDecodingData	*data;
-	TupleDesc			tupdesc;
-	Relation			defrel = NULL;
-	Bitmapset			*bs = NULL;
-	int					i;
-	Datum				*values;
-	bool				*nulls;
+	JsonDecodingData	*data = ctx->output_plugin_private;
+	ListCell			*lc;
 	bool				need_sep = false;
 
-	data = ctx->output_plugin_private;
+	OutputPluginPrepareWrite(ctx, true);
+	appendStringInfoString(ctx->out, "{\"action\":\"S\"");
+	pg_append_txn_fragment(ctx, txn);
 
-	tupdesc = RelationGetDescr(relation);
-	values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
-	nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+	if (data->include_lsn)
+	{
+		appendStringInfoString(ctx->out, ",\"lsn\":");
+		pg_append_lsn(data, ctx->out, commit_lsn);
 
-	/* break down the tuple into fields */
-	heap_deform_tuple(tuple, tupdesc, values, nulls);
+		appendStringInfoString(ctx->out, ",\"nextlsn\":");
+		pg_append_lsn(data, ctx->out, txn->end_lsn);
+	}
 
-	/* figure out replica identity columns */
-	if (kind == PGOUTPUTJSON_IDENTITY)
+	appendStringInfoString(ctx->out, ",\"tables\":{");
+	foreach(lc, data->summary_state->tables)
 	{
-		bs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_IDENTITY_KEY);
+		JsonSummaryEntry	*entry = (JsonSummaryEntry *) lfirst(lc);
+
+		if (need_sep)
+			appendStringInfoChar(ctx->out, ',');
+		need_sep = true;
+
+		pg_escape_json(ctx->out, entry->name);
+		appendStringInfo(ctx->out, ":{\"I\":" UINT64_FORMAT ",\"U\":" UINT64_FORMAT ",\"D\":" UINT64_FORMAT ",\"T\":" UINT64_FORMAT "}",
+						 entry->count[0], entry->count[1], entry->count[2], entry->count[3]);
 	}
-	else if (kind == PGOUTPUTJSON_PK)
-	{
-#if PG_VERSION_NUM >= 100000
-		bs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_PRIMARY_KEY);
+	appendStringInfoString(ctx->out, "}}");
+
+	OutputPluginWrite(ctx, true);
+}
+
+/*
+ * Merge a change into the net change of its row. Rows are identified by
+ * relation and replica identity. INSERT followed by UPDATEs is an INSERT,
+ * INSERT followed by DELETE is nothing and DELETE followed by INSERT is an
+ * UPDATE. Changes that cannot be merged (no replica identity, replica
+ * identity changes) are output right away after the buffered ones.
+ */
+static void
+pg_compact_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
+				 Relation relation, ReorderBufferChange *change)
+{
+	JsonDecodingData	*data = ctx->output_plugin_private;
+	JsonCompactState	*cs = data->compact_state;
+	JsonCompactEntry	*entry;
+	JsonCompactKey		key;
+	HeapTuple			newtuple = NULL;
+	HeapTuple			oldtuple = NULL;
+	HeapTuple			keytuple = NULL;
+	MemoryContext		old;
+	bool				found;
+	char				prev;
+
+#if PG_VERSION_NUM >= 170000
+	newtuple = change->data.tp.newtuple;
+	oldtuple = change->data.tp.oldtuple;
 #else
-		bs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_KEY);
+	if (change->data.tp.newtuple != NULL)
+		newtuple = &change->data.tp.newtuple->tuple;
+	if (change->data.tp.oldtuple != NULL)
+		oldtuple = &change->data.tp.oldtuple->tuple;
 #endif
-	}
 
-	/* open pg_attrdef in preparation to get default values from columns */
-	if (kind == PGOUTPUTJSON_CHANGE && data->include_default)
+	/* make sure rd_replidindex is set */
+	RelationGetIndexList(relation);
+
+	/*
+	 * Replica identity is a key only if it is an index. Old tuple is
+	 * available for an UPDATE iif replica identity changes.
+	 */
+	if (OidIsValid(relation->rd_replidindex))
 	{
-#if PG_VERSION_NUM >= 120000
-		defrel = table_open(AttrDefaultRelationId, AccessShareLock);
-#else
-		defrel = heap_open(AttrDefaultRelationId, AccessShareLock);
-#endif
+		switch (change->action)
+		{
+			case REORDER_BUFFER_CHANGE_INSERT:
+				keytuple = newtuple;
+				break;
+			case REORDER_BUFFER_CHANGE_UPDATE:
+				if (oldtuple == NULL)
+					keytuple = newtuple;
+				break;
+			case REORDER_BUFFER_CHANGE_DELETE:
+				keytuple = oldtuple;
+				break;
+			default:
+				Assert(false);
+		}
 	}
 
-	for (i = 0; i < tupdesc->natts; i++)
-	{
-		Form_pg_attribute	attr;
+	old = MemoryContextSwitchTo(cs->context);
 
-#if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
-		attr = tupdesc->attrs[i];
-#else
-		attr = TupleDescAttr(tupdesc, i);
-#endif
+	if (keytuple == NULL || !compact_build_key(relation, keytuple, &key))
+	{
+		MemoryContextSwitchTo(old);
+		pg_compact_flush(ctx, txn);
+		pg_decode_write_change(ctx, txn, relation, change);
+		return;
+	}
 
-		/* skip dropped or system columns */
-		if (attr->attisdropped || attr->attnum < 0)
-			continue;
+	if (cs->hash == NULL)
+	{
+		HASHCTL		ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(JsonCompactKey);
+		ctl.entrysize = sizeof(JsonCompactEntry);
+		ctl.hash = compact_key_hash;
+		ctl.match = compact_key_match;
+		ctl.hcxt = cs->context;
+		cs->hash = hash_create("wal2json compaction", 1024, &ctl,
+								HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+	}
 
-		if (bs != NULL && !bms_is_member(attr->attnum - FirstLowInvalidHeapAttributeNumber, bs))
-			continue;
+	entry = (JsonCompactEntry *) hash_search(cs->hash, (void *) &key, HASH_ENTER, &found);
+	if (!found)
+	{
+		entry->action = 0;
+		entry->seqno = -1;
+		memset(&entry->newtuple, 0, sizeof(JsonCompactTuple));
+		memset(&entry->oldtuple, 0, sizeof(JsonCompactTuple));
+	}
+	else
+		pfree(key.data);
 
-		/* don't send unchanged TOAST Datum */
-		if (!nulls[i] && attr->attlen == -1 && VARATT_IS_EXTERNAL_ONDISK(values[i]))
-			continue;
+	prev = entry->action;
 
-		if (need_sep)
-			appendStringInfoChar(ctx->out, ',');
-		need_sep = true;
+	switch (change->action)
+	{
+		case REORDER_BUFFER_CHANGE_INSERT:
+			entry->action = (prev == 'D') ? 'U' : 'I';
+			compact_store_tuple(data, &entry->newtuple, newtuple, RelationGetDescr(relation), false);
+			compact_clear_tuple(cs, &entry->oldtuple);
+			break;
+		case REORDER_BUFFER_CHANGE_UPDATE:
+			entry->action = (prev == 'I') ? 'I' : 'U';
+			/* unchanged TOAST columns keep the buffered values */
+			compact_store_tuple(data, &entry->newtuple, newtuple, RelationGetDescr(relation),
+								prev == 'I' || prev == 'U');
+			break;
+		case REORDER_BUFFER_CHANGE_DELETE:
+			entry->action = (prev == 'I') ? 0 : 'D';
+			compact_clear_tuple(cs, &entry->newtuple);
+			if (entry->action == 'D')
+				compact_store_tuple(data, &entry->oldtuple, oldtuple, RelationGetDescr(relation), false);
+			break;
+		default:
+			Assert(false);
+	}
 
-		appendStringInfoChar(ctx->out, '{');
-		appendStringInfoString(ctx->out, "\"name\":");
-		escape_json(ctx->out, NameStr(attr->attname));
+	entry->lsn = change->lsn;
+	cs->nchanges++;
 
-		/* type name (with typmod, if available) */
-		if (data->include_types)
+	/* a row that has no net change takes a new position if it changes again */
+	if (prev == 0 && entry->action != 0)
+	{
+		if (cs->npositions >= cs->maxpositions)
 		{
-			HeapTuple		type_tuple;
-			Form_pg_type	type_form;
-			char			*type_str;
-			int				len;
+			cs->maxpositions = (cs->maxpositions == 0) ? 1024 : cs->maxpositions * 2;
+			if (cs->positions == NULL)
+				cs->positions = palloc(cs->maxpositions * sizeof(JsonCompactPosition));
+			else
+				cs->positions = repalloc(cs->positions, cs->maxpositions * sizeof(JsonCompactPosition));
+		}
+		entry->seqno = cs->seqno++;
+		cs->positions[cs->npositions].entry = entry;
+		cs->positions[cs->npositions].seqno = entry->seqno;
+		cs->npositions++;
+	}
 
-			type_tuple = SearchSysCache1(TYPEOID, ObjectIdGetDatum(attr->atttypid));
-			type_form = (Form_pg_type) GETSTRUCT(type_tuple);
+	MemoryContextSwitchTo(old);
+}
 
-			/*
-			 * It is a domain. Replace domain name with base data type if
-			 * include_domain_data_type is enabled.
-			 */
-			if (type_form->typtype == TYPTYPE_DOMAIN && data->include_domain_data_type)
-				type_str = format_type_with_typemod(type_form->typbasetype, type_form->typtypmod);
-			else
-				type_str = format_type_with_typemod(attr->atttypid, attr->atttypmod);
+/* Output the buffered net changes in the order rows were first changed */
+static void
+pg_compact_flush(LogicalDecodingContext *ctx, ReorderBufferTXN *txn)
+{
+	JsonDecodingData	*data = ctx->output_plugin_private;
+	JsonCompactState	*cs = data->compact_state;
+	Relation			relation = NULL;
+	uint64				noutput = 0;
+	int					i;
 
-			appendStringInfoString(ctx->out, ",\"type\":");
-			/*
-			 * format_type_with_typemod() returns a quoted identifier, if
-			 * required. In this case, it doesn't need to enclose the type name
-			 * in double quotes. However, if it is an array type, it should
-			 * escape it because the brackets are outside the double quotes.
-			 */
-			len = strlen(type_str);
-			if (type_str[0] == '"' && type_str[len -1] != ']')
-				appendStringInfo(ctx->out, "%s", type_str);
-			else
-				escape_json(ctx->out, type_str);
-			pfree(type_str);
+	for (i = 0; i < cs->npositions; i++)
+	{
+		JsonCompactEntry	*entry = cs->positions[i].entry;
+		ReorderBufferChange	change;
+		HeapTuple			newtuple;
+		HeapTuple			oldtuple;
+		MemoryContext		old;
+#if PG_VERSION_NUM < 170000
+		ReorderBufferTupleBuf	newbuf;
+		ReorderBufferTupleBuf	oldbuf;
+#endif
 
-			ReleaseSysCache(type_tuple);
-		}
+		/* row changed again after it had no net change */
+		if (entry->seqno != cs->positions[i].seqno || entry->action == 0)
+			continue;
 
-		/*
-		 * Print type oid for columns.
-		 */
-		if (data->include_type_oids)
+		if (relation == NULL || RelationGetRelid(relation) != entry->key.relid)
 		{
-			appendStringInfoString(ctx->out, ",\"typeoid\":");
-			appendStringInfo(ctx->out, "%d", attr->atttypid);
+			if (relation != NULL)
+				RelationClose(relation);
+			relation = RelationIdGetRelation(entry->key.relid);
+			if (!RelationIsValid(relation))
+				elog(ERROR, "could not open relation with OID %u", entry->key.relid);
 		}
 
-		if (kind != PGOUTPUTJSON_PK)
-		{
-			appendStringInfoString(ctx->out, ",\"value\":");
-			pg_decode_write_value(ctx, values[i], nulls[i], attr->atttypid);
-		}
+		old = MemoryContextSwitchTo(cs->output_context);
 
-		/*
-		 * Print optional for columns. This information is redundant for
-		 * replica identity (index) because all attributes are not null.
-		 */
-		if (kind == PGOUTPUTJSON_CHANGE && data->include_not_null)
+		memset(&change, 0, sizeof(ReorderBufferChange));
+		switch (entry->action)
 		{
-			if (attr->attnotnull)
-				appendStringInfoString(ctx->out, ",\"optional\":false");
-			else
-				appendStringInfoString(ctx->out, ",\"optional\":true");
+			case 'I':
+				change.action = REORDER_BUFFER_CHANGE_INSERT;
+				break;
+			case 'U':
+				change.action = REORDER_BUFFER_CHANGE_UPDATE;
+				break;
+			case 'D':
+				change.action = REORDER_BUFFER_CHANGE_DELETE;
+				break;
 		}
+		change.lsn = entry->lsn;
 
-		/*
-		 * Print position for columns. Positions are only available for new
-		 * tuple (INSERT, UPDATE).
-		 */
-		if (kind == PGOUTPUTJSON_CHANGE && data->include_column_positions)
+		newtuple = compact_load_tuple(cs, &entry->newtuple, entry->key.relid);
+		oldtuple = compact_load_tuple(cs, &entry->oldtuple, entry->key.relid);
+#if PG_VERSION_NUM >= 170000
+		change.data.tp.newtuple = newtuple;
+		change.data.tp.oldtuple = oldtuple;
+#else
+		if (newtuple != NULL)
 		{
-			appendStringInfoString(ctx->out, ",\"position\":");
-			appendStringInfo(ctx->out, "%d", attr->attnum);
+			memset(&newbuf, 0, sizeof(ReorderBufferTupleBuf));
+			newbuf.tuple = *newtuple;
+			change.data.tp.newtuple = &newbuf;
 		}
-
-		/*
-		 * Print default for columns.
-		 */
-		if (kind == PGOUTPUTJSON_CHANGE && data->include_default)
+		if (oldtuple != NULL)
 		{
-#if PG_VERSION_NUM >= 120000
-			if (attr->atthasdef && attr->attgenerated == '\0')
-#else
-			if (attr->atthasdef)
-#endif
-			{
-				ScanKeyData			scankeys[2];
-				SysScanDesc			scan;
-				HeapTuple			def_tuple;
-				Datum				def_value;
-				bool				isnull;
-				char				*result;
-
-				ScanKeyInit(&scankeys[0],
-							Anum_pg_attrdef_adrelid,
-							BTEqualStrategyNumber, F_OIDEQ,
-							ObjectIdGetDatum(relation->rd_id));
-				ScanKeyInit(&scankeys[1],
-							Anum_pg_attrdef_adnum,
-							BTEqualStrategyNumber, F_INT2EQ,
-							Int16GetDatum(attr->attnum));
-
-				scan = systable_beginscan(defrel, AttrDefaultIndexId, true,
-											NULL, 2, scankeys);
-
-				def_tuple = systable_getnext(scan);
-				if (HeapTupleIsValid(def_tuple))
-				{
-					def_value = fastgetattr(def_tuple, Anum_pg_attrdef_adbin, defrel->rd_att, &isnull);
-
-					if (!isnull)
-					{
-						result = TextDatumGetCString(DirectFunctionCall2(pg_get_expr,
-																	def_value,
-																	ObjectIdGetDatum(relation->rd_id)));
-
-						appendStringInfoString(ctx->out, ",\"default\":");
-						appendStringInfo(ctx->out, "\"%s\"", result);
-						pfree(result);
-					}
-					else
-					{
-						/*
-						 * null means that default was not set. Is it possible?
-						 * atthasdef shouldn't be set.
-						 */
-						appendStringInfoString(ctx->out, ",\"default\":null");
-					}
-				}
-
-				systable_endscan(scan);
-			}
-			else
-			{
-				/*
-				 * no DEFAULT clause implicitly means that the default is NULL
-				 */
-				appendStringInfoString(ctx->out, ",\"default\":null");
-			}
+			memset(&oldbuf, 0, sizeof(ReorderBufferTupleBuf));
+			oldbuf.tuple = *oldtuple;
+			change.data.tp.oldtuple = &oldbuf;
 		}
+#endif
 
-		appendStringInfoChar(ctx->out, '}');
-	}
+		pg_decode_write_change(ctx, txn, relation, &change);
+		noutput++;
 
-	/* close pg_attrdef */
-	if (kind == PGOUTPUTJSON_CHANGE && data->include_default)
-	{
-#if PG_VERSION_NUM >= 120000
-		table_close(defrel, AccessShareLock);
-#else
-		heap_close(defrel, AccessShareLock);
-#endif
+		MemoryContextSwitchTo(old);
+		MemoryContextReset(cs->output_context);
 	}
 
-	bms_free(bs);
+	if (relation != NULL)
+		RelationClose(relation);
 
-	pfree(values);
-	pfree(nulls);
+	if (cs->nchanges > 0)
+		elog(DEBUG1, "compact-changes: " UINT64_FORMAT " changes were output as " UINT64_FORMAT " changes", cs->nchanges, noutput);
+
+	compact_reset(cs);
 }
 
+/* Discard buffered changes */
 static void
-pg_decode_write_change(LogicalDecodingContext *ctx, ReorderBufferTXN *txn, Relation relation, ReorderBufferChange *change)
+compact_reset(JsonCompactState *cs)
 {
-	JsonDecodingData *data = ctx->output_plugin_private;
+	if (cs->file != NULL)
+		BufFileClose(cs->file);
+	cs->file = NULL;
+	cs->endfileno = 0;
+	cs->endoffset = 0;
+
+	MemoryContextReset(cs->context);
+	cs->hash = NULL;
+	cs->positions = NULL;
+	cs->npositions = 0;
+	cs->maxpositions = 0;
+	cs->seqno = 0;
+	cs->nchanges = 0;
+	cs->bytes = 0;
+}
 
-	/* make sure rd_pkindex and rd_replidindex are set */
-	RelationGetIndexList(relation);
+/*
+ * Build the key of a row from its replica identity values. Values that are
+ * stored out of line cannot be compared hence they are not keys.
+ */
+static bool
+compact_build_key(Relation relation, HeapTuple tuple, JsonCompactKey *key)
+{
+	TupleDesc		tupdesc = RelationGetDescr(relation);
+	Bitmapset		*bs;
+	StringInfoData	buf;
+	int				x;
 
-	switch (change->action)
+	bs = RelationGetIndexAttrBitmap(relation, INDEX_ATTR_BITMAP_IDENTITY_KEY);
+	if (bs == NULL)
+		return false;
+
+	initStringInfo(&buf);
+
+#if PG_VERSION_NUM >= 90500
+	x = -1;
+	while ((x = bms_next_member(bs, x)) >= 0)
+#else
+	while ((x = bms_first_member(bs)) >= 0)
+#endif
 	{
-		case REORDER_BUFFER_CHANGE_INSERT:
-			if (change->data.tp.newtuple == NULL)
-			{
-				elog(WARNING, "no tuple data for INSERT in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
-				return;
-			}
-			break;
-		case REORDER_BUFFER_CHANGE_UPDATE:
-			if (change->data.tp.newtuple == NULL)
-			{
-				elog(WARNING, "no tuple data for UPDATE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
-				return;
-			}
-			if (change->data.tp.oldtuple == NULL)
-			{
-				if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
-				{
-					elog(WARNING, "no tuple identifier for UPDATE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
-					return;
-				}
-			}
-			break;
-		case REORDER_BUFFER_CHANGE_DELETE:
-			if (change->data.tp.oldtuple == NULL)
+		AttrNumber			attnum = x + FirstLowInvalidHeapAttributeNumber;
+		Form_pg_attribute	attr;
+		Datum				value;
+		bool				isnull;
+
+		if (attnum <= 0)
+			continue;
+
+#if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
+		attr = tupdesc->attrs[attnum - 1];
+#else
+		attr = TupleDescAttr(tupdesc, attnum - 1);
+#endif
+
+		value = heap_getattr(tuple, attnum, tupdesc, &isnull);
+
+		appendBinaryStringInfo(&buf, (char *) &isnull, sizeof(bool));
+		if (isnull)
+			continue;
+
+		if (attr->attbyval)
+			appendBinaryStringInfo(&buf, (char *) &value, sizeof(Datum));
+		else if (attr->attlen > 0)
+			appendBinaryStringInfo(&buf, DatumGetPointer(value), attr->attlen);
+		else
+		{
+			struct varlena	*v = (struct varlena *) DatumGetPointer(value);
+			uint32			len;
+
+			if (attr->attlen == -1)
 			{
-				if (!OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident != REPLICA_IDENTITY_FULL)
+				if (VARATT_IS_EXTERNAL(v))
 				{
-					elog(WARNING, "no tuple identifier for DELETE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
-					return;
+					pfree(buf.data);
+					bms_free(bs);
+					return false;
 				}
+				if (VARATT_IS_COMPRESSED(v))
+					v = pg_detoast_datum_packed(v);
+				len = VARSIZE_ANY(v);
 			}
-			break;
-		default:
-			Assert(false);
+			else
+				len = strlen((char *) v) + 1;
+
+			appendBinaryStringInfo(&buf, (char *) &len, sizeof(uint32));
+			appendBinaryStringInfo(&buf, (char *) v, len);
+		}
 	}
 
-	OutputPluginPrepareWrite(ctx, true);
+	bms_free(bs);
 
-	appendStringInfoChar(ctx->out, '{');
+	key->relid = RelationGetRelid(relation);
+	key->len = buf.len;
+	key->data = buf.data;
 
-	switch (change->action)
-	{
-		case REORDER_BUFFER_CHANGE_INSERT:
-			appendStringInfoString(ctx->out, "\"action\":\"I\"");
-			break;
-		case REORDER_BUFFER_CHANGE_UPDATE:
-			appendStringInfoString(ctx->out, "\"action\":\"U\"");
-			break;
-		case REORDER_BUFFER_CHANGE_DELETE:
-			appendStringInfoString(ctx->out, "\"action\":\"D\"");
-			break;
-		default:
-			Assert(false);
-	}
+	return true;
+}
 
-	if (data->include_xids)
-		appendStringInfo(ctx->out, ",\"xid\":%u", txn->xid);
+static uint32
+compact_key_hash(const void *key, Size keysize)
+{
+	const JsonCompactKey *k = (const JsonCompactKey *) key;
 
-#if PG_VERSION_NUM >= 150000
-	if (data->include_timestamp)
-		appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->xact_time.commit_time));
-#else
-	if (data->include_timestamp)
-		appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->commit_time));
-#endif
+	return DatumGetUInt32(hash_any((const unsigned char *) k->data, k->len)) ^ k->relid;
+}
 
-#if PG_VERSION_NUM >= 90500
-	if (data->include_origin)
-		appendStringInfo(ctx->out, ",\"origin\":%u", txn->origin_id);
-#endif
+static int
+compact_key_match(const void *key1, const void *key2, Size keysize)
+{
+	const JsonCompactKey *k1 = (const JsonCompactKey *) key1;
+	const JsonCompactKey *k2 = (const JsonCompactKey *) key2;
 
-	if (data->include_lsn)
-	{
-		char *lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(change->lsn)));
-		appendStringInfo(ctx->out, ",\"lsn\":\"%s\"", lsn_str);
-		pfree(lsn_str);
-	}
+	if (k1->relid != k2->relid || k1->len != k2->len)
+		return 1;
 
-	if (data->include_schemas)
-	{
-		appendStringInfo(ctx->out, ",\"schema\":");
-		escape_json(ctx->out, get_namespace_name(RelationGetNamespace(relation)));
-	}
+	return memcmp(k1->data, k2->data, k1->len);
+}
 
-	appendStringInfo(ctx->out, ",\"table\":");
-	escape_json(ctx->out, RelationGetRelationName(relation));
+/*
+ * Keep a copy of the tuple. Values that logical decoding reassembled from
+ * TOAST chunks are released after the change hence they are copied too. If
+ * merge is set, the tuple replaces the one in ct and columns that an UPDATE
+ * left unchanged (TOAST pointers on disk) are taken from the replaced tuple;
+ * otherwise a merged INSERT would miss them and a merged UPDATE would lose
+ * values that an earlier UPDATE changed. If the memory limit is reached, the
+ * tuple is written to a temporary file.
+ */
+static void
+compact_store_tuple(JsonDecodingData *data, JsonCompactTuple *ct, HeapTuple tuple, TupleDesc tupdesc, bool merge)
+{
+	JsonCompactState	*cs = data->compact_state;
+	HeapTuple			copy = NULL;
+	HeapTuple			prev = NULL;
+	int					i;
 
-	/* print new tuple (INSERT, UPDATE) */
-	if (change->data.tp.newtuple != NULL)
+	if (tuple == NULL)
 	{
-		appendStringInfoString(ctx->out, ",\"columns\":[");
-#if PG_VERSION_NUM >= 170000
-		pg_decode_write_tuple(ctx, relation, change->data.tp.newtuple, PGOUTPUTJSON_CHANGE);
-#else
-		pg_decode_write_tuple(ctx, relation, &change->data.tp.newtuple->tuple, PGOUTPUTJSON_CHANGE);
-#endif
-		appendStringInfoChar(ctx->out, ']');
+		compact_clear_tuple(cs, ct);
+		return;
 	}
 
-	/*
-	 * Print old tuple (UPDATE, DELETE)
-	 *
-	 * old tuple is available when:
-	 * (1) primary key changes;
-	 * (2) replica identity is index and one of the indexed columns changes;
-	 * (3) replica identity is full.
-	 *
-	 * If old tuple is not available (because (a) primary key does not change
-	 * or (b) replica identity is index and none of indexed columns does not
-	 * change) identity is obtained from new tuple (because it doesn't change).
-	 *
-	 */
-	if (change->data.tp.oldtuple != NULL)
+	if (merge)
+		prev = compact_load_tuple(cs, ct, InvalidOid);
+
+	for (i = 0; i < tupdesc->natts; i++)
 	{
-		appendStringInfoString(ctx->out, ",\"identity\":[");
-#if	PG_VERSION_NUM >= 170000
-		pg_decode_write_tuple(ctx, relation, change->data.tp.oldtuple, PGOUTPUTJSON_IDENTITY);
+		Form_pg_attribute	attr;
+		Datum				value;
+		bool				isnull;
+
+#if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
+		attr = tupdesc->attrs[i];
 #else
-		pg_decode_write_tuple(ctx, relation, &change->data.tp.oldtuple->tuple, PGOUTPUTJSON_IDENTITY);
+		attr = TupleDescAttr(tupdesc, i);
 #endif
-		appendStringInfoChar(ctx->out, ']');
+
+		if (attr->attisdropped || attr->attlen != -1)
+			continue;
+
+		value = heap_getattr(tuple, i + 1, tupdesc, &isnull);
+		if (!isnull && (VARATT_IS_EXTERNAL_INDIRECT(DatumGetPointer(value)) ||
+						(prev != NULL && VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(value)))))
+			break;
 	}
-	else
+
+	if (i < tupdesc->natts)
 	{
-		/*
-		 * Old tuple is not available, however, identity can be obtained from
-		 * new tuple (because it doesn't change).
-		 */
-		if (change->action == REORDER_BUFFER_CHANGE_UPDATE)
+		Datum	*values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+		bool	*nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+
+		heap_deform_tuple(tuple, tupdesc, values, nulls);
+		for (i = 0; i < tupdesc->natts; i++)
 		{
-			elog(DEBUG2, "old tuple is null on UPDATE");
+			Form_pg_attribute	attr;
 
-			/*
-			 * Before v10, there is not rd_pkindex then rely on REPLICA
-			 * IDENTITY DEFAULT to obtain primary key.
-			 */
-#if PG_VERSION_NUM >= 100000
-			if (OidIsValid(relation->rd_pkindex) || OidIsValid(relation->rd_replidindex))
+#if (PG_VERSION_NUM >= 90600 && PG_VERSION_NUM < 90605) || (PG_VERSION_NUM >= 90500 && PG_VERSION_NUM < 90509) || (PG_VERSION_NUM >= 90400 && PG_VERSION_NUM < 90414)
+			attr = tupdesc->attrs[i];
 #else
-			if (OidIsValid(relation->rd_replidindex))
+			attr = TupleDescAttr(tupdesc, i);
 #endif
+
+			if (nulls[i] || attr->attisdropped || attr->attlen != -1)
+				continue;
+
+			if (prev != NULL && VARATT_IS_EXTERNAL_ONDISK(DatumGetPointer(values[i])))
 			{
-				elog(DEBUG1, "REPLICA IDENTITY: obtain old tuple using new tuple");
-				appendStringInfoString(ctx->out, ",\"identity\":[");
-#if PG_VERSION_NUM >= 170000
-				pg_decode_write_tuple(ctx, relation, change->data.tp.newtuple, PGOUTPUTJSON_IDENTITY);
+				/* buffered values are never indirect */
+				values[i] = heap_getattr(prev, i + 1, tupdesc, &nulls[i]);
+				continue;
+			}
+
+			if (!VARATT_IS_EXTERNAL_INDIRECT(DatumGetPointer(values[i])))
+				continue;
+
+#if PG_VERSION_NUM >= 130000
+			values[i] = PointerGetDatum(detoast_external_attr((struct varlena *) DatumGetPointer(values[i])));
 #else
-				pg_decode_write_tuple(ctx, relation, &change->data.tp.newtuple->tuple, PGOUTPUTJSON_IDENTITY);
+			values[i] = PointerGetDatum(heap_tuple_fetch_attr((struct varlena *) DatumGetPointer(values[i])));
 #endif
-				appendStringInfoChar(ctx->out, ']');
-			}
-			else
-			{
-				/* old tuple is not available and can't be obtained, report it */
-				elog(WARNING, "no old tuple data for UPDATE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
-			}
 		}
+		copy = heap_form_tuple(tupdesc, values, nulls);
 
-		/* old tuple is not available and can't be obtained, report it */
-		if (change->action == REORDER_BUFFER_CHANGE_DELETE)
-		{
-			elog(WARNING, "no old tuple data for DELETE in table \"%s\".\"%s\"", get_namespace_name(RelationGetNamespace(relation)), RelationGetRelationName(relation));
-		}
+		pfree(values);
+		pfree(nulls);
+	}
+	else
+		copy = heap_copytuple(tuple);
+
+	/* a spilled tuple was read into a copy */
+	if (prev != NULL && prev != ct->tuple)
+		heap_freetuple(prev);
+	compact_clear_tuple(cs, ct);
+
+	if (cs->bytes + copy->t_len <= (Size) data->compact_memory_limit * 1024)
+	{
+		ct->tuple = copy;
+		cs->bytes += copy->t_len;
+		return;
 	}
 
-	if (data->include_pk)
+	/* append to the temporary file */
+	if (cs->file == NULL)
 	{
-		appendStringInfoString(ctx->out, ",\"pk\":[");
-#if PG_VERSION_NUM >= 100000
-		if (OidIsValid(relation->rd_pkindex))
-#else
-		if (OidIsValid(relation->rd_replidindex) && relation->rd_rel->relreplident == REPLICA_IDENTITY_DEFAULT)
-#endif
-		{
-#if PG_VERSION_NUM >= 170000
-			if (change->data.tp.oldtuple != NULL)
-				pg_decode_write_tuple(ctx, relation, change->data.tp.oldtuple, PGOUTPUTJSON_PK);
-			else
-				pg_decode_write_tuple(ctx, relation, change->data.tp.newtuple, PGOUTPUTJSON_PK);
+		cs->file = BufFileCreateTemp(false);
+		cs->endfileno = 0;
+		cs->endoffset = 0;
+	}
+
+	if (BufFileSeek(cs->file, cs->endfileno, cs->endoffset, SEEK_SET) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in compaction temporary file")));
+
+	ct->spilled = true;
+	ct->fileno = cs->endfileno;
+	ct->offset = cs->endoffset;
+	ct->len = copy->t_len;
+
+#if PG_VERSION_NUM >= 130000
+	BufFileWrite(cs->file, copy->t_data, copy->t_len);
 #else
-			if (change->data.tp.oldtuple != NULL)
-				pg_decode_write_tuple(ctx, relation, &change->data.tp.oldtuple->tuple, PGOUTPUTJSON_PK);
-			else
-				pg_decode_write_tuple(ctx, relation, &change->data.tp.newtuple->tuple, PGOUTPUTJSON_PK);
+	if (BufFileWrite(cs->file, copy->t_data, copy->t_len) != copy->t_len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not write to compaction temporary file: %m")));
 #endif
-		}
-		appendStringInfoChar(ctx->out, ']');
-	}
 
-	appendStringInfoChar(ctx->out, '}');
+	BufFileTell(cs->file, &cs->endfileno, &cs->endoffset);
 
-	OutputPluginWrite(ctx, true);
+	heap_freetuple(copy);
 }
 
 static void
-pg_decode_change_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
-				 Relation relation, ReorderBufferChange *change)
+compact_clear_tuple(JsonCompactState *cs, JsonCompactTuple *ct)
 {
-	JsonDecodingData *data = ctx->output_plugin_private;
-	MemoryContext old;
+	if (ct->tuple != NULL)
+	{
+		cs->bytes -= ct->tuple->t_len;
+		heap_freetuple(ct->tuple);
+	}
 
-	char	*schemaname;
-	char	*tablename;
+	/* spilled tuples are left in the file */
+	memset(ct, 0, sizeof(JsonCompactTuple));
+}
 
-	/* filter changes by action */
-	if (pg_filter_by_action(change->action, data->actions))
-		return;
+/* Get the tuple, reading it from the temporary file if needed */
+static HeapTuple
+compact_load_tuple(JsonCompactState *cs, JsonCompactTuple *ct, Oid relid)
+{
+	HeapTuple	tuple;
 
-	/* avoid leaking memory by using and resetting our own context */
-	old = MemoryContextSwitchTo(data->context);
+	if (ct->tuple != NULL)
+		return ct->tuple;
 
-	/* schema and table names are used for chosen tables */
-	schemaname = get_namespace_name(RelationGetNamespace(relation));
-	tablename = RelationGetRelationName(relation);
+	if (!ct->spilled)
+		return NULL;
 
-	/* Exclude tables, if available */
-	if (pg_filter_by_table(data->filter_tables, schemaname, tablename))
-	{
-		MemoryContextSwitchTo(old);
-		MemoryContextReset(data->context);
-		return;
-	}
+	tuple = (HeapTuple) palloc(HEAPTUPLESIZE + ct->len);
+	tuple->t_len = ct->len;
+	ItemPointerSetInvalid(&tuple->t_self);
+	tuple->t_tableOid = relid;
+	tuple->t_data = (HeapTupleHeader) ((char *) tuple + HEAPTUPLESIZE);
 
-	/* Add tables */
-	if (!pg_add_by_table(data->add_tables, schemaname, tablename))
-	{
-		MemoryContextSwitchTo(old);
-		MemoryContextReset(data->context);
-		return;
-	}
+	if (BufFileSeek(cs->file, ct->fileno, ct->offset, SEEK_SET) != 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not seek in compaction temporary file")));
 
-	pg_decode_write_change(ctx, txn, relation, change);
+#if PG_VERSION_NUM >= 160000
+	BufFileReadExact(cs->file, tuple->t_data, ct->len);
+#else
+	if (BufFileRead(cs->file, tuple->t_data, ct->len) != ct->len)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not read from compaction temporary file: %m")));
+#endif
 
-	MemoryContextSwitchTo(old);
-	MemoryContextReset(data->context);
+	return tuple;
 }
 
 #if PG_VERSION_NUM >= 90600
@@ -2586,41 +6308,17 @@ pg_decode_message(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 #endif
 
 	/* Filter message prefixes, if available */
-	if (list_length(data->filter_msg_prefixes) > 0)
+	if (data->filter_prefixes != NULL && pg_match_prefix(data->filter_prefixes, prefix))
 	{
-		ListCell	*lc;
-
-		foreach(lc, data->filter_msg_prefixes)
-		{
-			char	*p = lfirst(lc);
-
-			if (strcmp(p, prefix) == 0)
-			{
-				elog(DEBUG2, "message prefix \"%s\" was filtered out", p);
-				return;
-			}
-		}
+		elog(DEBUG2, "message prefix \"%s\" was filtered out", prefix);
+		return;
 	}
 
 	/* Add messages by prefix */
-	if (list_length(data->add_msg_prefixes) > 0)
+	if (data->add_prefixes != NULL && !pg_match_prefix(data->add_prefixes, prefix))
 	{
-		ListCell	*lc;
-		bool		skip = true;
-
-		foreach(lc, data->add_msg_prefixes)
-		{
-			char	*p = lfirst(lc);
-
-			if (strcmp(p, prefix) == 0)
-				skip = false;
-		}
-
-		if (skip)
-		{
-			elog(DEBUG2, "message prefix \"%s\" was skipped", prefix);
-			return;
-		}
+		elog(DEBUG2, "message prefix \"%s\" was skipped", prefix);
+		return;
 	}
 
 	if (data->format_version == 2)
@@ -2685,12 +6383,12 @@ pg_decode_message_v1(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 		appendStringInfo(ctx->out, "%s%s%s\"transactional\":%sfalse,%s", data->ht, data->ht, data->ht, data->sp, data->nl);
 
 	appendStringInfo(ctx->out, "%s%s%s\"prefix\":%s", data->ht, data->ht, data->ht, data->sp);
-	escape_json(ctx->out, prefix);
+	pg_escape_json(ctx->out, prefix);
 	appendStringInfo(ctx->out, ",%s%s%s%s\"content\":%s", data->nl, data->ht, data->ht, data->ht, data->sp);
 
 	content_str = (char *) palloc0((content_size + 1) * sizeof(char));
 	strncpy(content_str, content, content_size);
-	escape_json(ctx->out, content_str);
+	pg_escape_json(ctx->out, content_str);
 	pfree(content_str);
 
 	appendStringInfo(ctx->out, "%s%s%s}", data->nl, data->ht, data->ht);
@@ -2715,6 +6413,14 @@ pg_decode_message_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	MemoryContext		old;
 	char				*content_str;
 
+	/* summary outputs only one object per transaction */
+	if (data->summary)
+		return;
+
+	/* buffered changes precede a transactional message */
+	if (transactional && data->compact_changes && data->compact_state->active)
+		pg_compact_flush(ctx, txn);
+
 	/* Avoid leaking memory by using and resetting our own context */
 	old = MemoryContextSwitchTo(data->context);
 
@@ -2722,46 +6428,28 @@ pg_decode_message_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 	appendStringInfoChar(ctx->out, '{');
 	appendStringInfoString(ctx->out, "\"action\":\"M\"");
 
-	if (data->include_xids)
+	/*
+	 * Non-transactional messages can have no xid, hence, assigns null in
+	 * this case.  Assigns null for xid in non-transactional messages
+	 * because in some cases there isn't an assigned xid.
+	 * This same logic is valid for timestamp and origin.
+	 */
+	if (transactional)
+		pg_append_txn_fragment(ctx, txn);
+	else
 	{
-		/*
-		 * Non-transactional messages can have no xid, hence, assigns null in
-		 * this case.  Assigns null for xid in non-transactional messages
-		 * because in some cases there isn't an assigned xid.
-		 * This same logic is valid for timestamp and origin.
-		 */
-		if (transactional)
-			appendStringInfo(ctx->out, ",\"xid\":%u", txn->xid);
-		else
+		if (data->include_xids)
 			appendStringInfoString(ctx->out, ",\"xid\":null");
-	}
-
-	if (data->include_timestamp)
-	{
-#if PG_VERSION_NUM >= 150000
-		if (transactional)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->xact_time.commit_time));
-#else
-		if (transactional)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->commit_time));
-#endif
-		else
+		if (data->include_timestamp)
 			appendStringInfoString(ctx->out, ",\"timestamp\":null");
-	}
-
-	if (data->include_origin)
-	{
-		if (transactional)
-			appendStringInfo(ctx->out, ",\"origin\":%u", txn->origin_id);
-		else
-			appendStringInfo(ctx->out, ",\"origin\":null");
+		if (data->include_origin)
+			appendStringInfoString(ctx->out, ",\"origin\":null");
 	}
 
 	if (data->include_lsn)
 	{
-		char *lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(lsn)));
-		appendStringInfo(ctx->out, ",\"lsn\":\"%s\"", lsn_str);
-		pfree(lsn_str);
+		appendStringInfoString(ctx->out, ",\"lsn\":");
+		pg_append_lsn(data, ctx->out, lsn);
 	}
 
 	if (transactional)
@@ -2770,12 +6458,12 @@ pg_decode_message_v2(LogicalDecodingContext *ctx, ReorderBufferTXN *txn,
 		appendStringInfoString(ctx->out, ",\"transactional\":false");
 
 	appendStringInfoString(ctx->out, ",\"prefix\":");
-	escape_json(ctx->out, prefix);
+	pg_escape_json(ctx->out, prefix);
 
 	appendStringInfoString(ctx->out, ",\"content\":");
 	content_str = (char *) palloc0((content_size + 1) * sizeof(char));
 	strncpy(content_str, content, content_size);
-	escape_json(ctx->out, content_str);
+	pg_escape_json(ctx->out, content_str);
 	pfree(content_str);
 
 	appendStringInfoChar(ctx->out, '}');
@@ -2877,22 +6565,25 @@ static void pg_decode_truncate_v1(LogicalDecodingContext *ctx,
 	if (data->include_xids)
 		appendStringInfo(ctx->out, "%s%s%s\"xid\":%s%u,%s", data->ht, data->ht, data->ht, data->sp, txn->xid, data->nl);
 
-#if PG_VERSION_NUM >= 150000
 	if (data->include_timestamp)
-		appendStringInfo(ctx->out, "%s%s%s\"timestamp\":%s\"%s\",%s", data->ht, data->ht, data->ht, data->sp, timestamptz_to_str(txn->xact_time.commit_time), data->nl);
+	{
+		appendStringInfo(ctx->out, "%s%s%s\"timestamp\":%s", data->ht, data->ht, data->ht, data->sp);
+#if PG_VERSION_NUM >= 150000
+		pg_append_timestamp(data, ctx->out, txn->xact_time.commit_time);
 #else
-	if (data->include_timestamp)
-		appendStringInfo(ctx->out, "%s%s%s\"timestamp\":%s\"%s\",%s", data->ht, data->ht, data->ht, data->sp, timestamptz_to_str(txn->commit_time), data->nl);
+		pg_append_timestamp(data, ctx->out, txn->commit_time);
 #endif
+		appendStringInfo(ctx->out, ",%s", data->nl);
+	}
 
 	if (data->include_origin)
 		appendStringInfo(ctx->out, "%s%s%s\"origin\":%s%u,%s", data->ht, data->ht, data->ht, data->sp, txn->origin_id, data->nl);
 
 	if (data->include_lsn)
 	{
-		char *lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(change->lsn)));
-		appendStringInfo(ctx->out, "%s%s%s\"lsn\":%s\"%s\",%s", data->ht, data->ht, data->ht, data->sp, lsn_str, data->nl);
-		pfree(lsn_str);
+		appendStringInfo(ctx->out, "%s%s%s\"lsn\":%s", data->ht, data->ht, data->ht, data->sp);
+		pg_append_lsn(data, ctx->out, change->lsn);
+		appendStringInfo(ctx->out, ",%s", data->nl);
 	}
 
 	for (i = 0; i < n; i++)
@@ -2900,12 +6591,12 @@ static void pg_decode_truncate_v1(LogicalDecodingContext *ctx,
 		if (data->include_schemas)
 		{
 			appendStringInfo(ctx->out, "%s%s%s\"schema\":%s", data->ht, data->ht, data->ht, data->sp);
-			escape_json(ctx->out, get_namespace_name(RelationGetNamespace(relations[i])));
+			pg_escape_json(ctx->out, get_namespace_name(RelationGetNamespace(relations[i])));
 			appendStringInfo(ctx->out, ",%s", data->nl);
 		}
 
 		appendStringInfo(ctx->out, "%s%s%s\"table\":%s", data->ht, data->ht, data->ht, data->sp);
-		escape_json(ctx->out, RelationGetRelationName(relations[i]));
+		pg_escape_json(ctx->out, RelationGetRelationName(relations[i]));
 	}
 
 	appendStringInfo(ctx->out, "%s%s%s}", data->nl, data->ht, data->ht);
@@ -2926,73 +6617,70 @@ static void pg_decode_truncate_v2(LogicalDecodingContext *ctx,
 	MemoryContext old;
 	int		i;
 
-	if (!data->actions.truncate)
-	{
-		elog(DEBUG3, "ignore TRUNCATE");
-		return;
-	}
+	/* buffered changes precede TRUNCATE */
+	if (data->compact_changes && data->compact_state->active)
+		pg_compact_flush(ctx, txn);
 
 	/* avoid leaking memory by using and resetting our own context */
 	old = MemoryContextSwitchTo(data->context);
 
 	for (i = 0; i < n; i++)
 	{
+		JsonRelationEntry	*entry;
 		char	*schemaname;
 		char	*tablename;
 
-		/* schema and table names are used for chosen tables */
-		schemaname = get_namespace_name(RelationGetNamespace(relations[i]));
-		tablename = RelationGetRelationName(relations[i]);
+		/* table filters and actions are evaluated once per relation */
+		entry = get_relation_entry(data, relations[i]);
 
-		/* Exclude tables, if available */
-		if (pg_filter_by_table(data->filter_tables, schemaname, tablename))
+		if (!entry->actions.truncate)
 		{
-			MemoryContextSwitchTo(old);
-			MemoryContextReset(data->context);
+			elog(DEBUG3, "ignore TRUNCATE");
 			continue;
 		}
 
-		/* Add tables */
-		if (!pg_add_by_table(data->add_tables, schemaname, tablename))
+		/* Exclude tables (filter-tables and add-tables), if available */
+		if (!entry->selected)
+			continue;
+
+		/* partitions are truncated by truncating the partition root */
+		if (entry->publish_as_relid != RelationGetRelid(relations[i]))
+			continue;
+
+		/* every shard has rows of this table unless it is sharded by table */
+		if (data->shard_count > 1 && data->shard_by_table &&
+			entry->tablehash % data->shard_count != data->shard_id)
+			continue;
+
+		if (data->summary)
 		{
-			MemoryContextSwitchTo(old);
-			MemoryContextReset(data->context);
+			pg_summary_count(data, relations[i], 3);
 			continue;
 		}
 
+		schemaname = get_namespace_name(RelationGetNamespace(relations[i]));
+		tablename = RelationGetRelationName(relations[i]);
+
 		OutputPluginPrepareWrite(ctx, true);
 		appendStringInfoChar(ctx->out, '{');
 		appendStringInfoString(ctx->out, "\"action\":\"T\"");
 
-		if (data->include_xids)
-			appendStringInfo(ctx->out, ",\"xid\":%u", txn->xid);
-
-#if PG_VERSION_NUM >= 150000
-		if (data->include_timestamp)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->xact_time.commit_time));
-#else
-		if (data->include_timestamp)
-			appendStringInfo(ctx->out, ",\"timestamp\":\"%s\"", timestamptz_to_str(txn->commit_time));
-#endif
-
-		if (data->include_origin)
-			appendStringInfo(ctx->out, ",\"origin\":%u", txn->origin_id);
+		pg_append_txn_fragment(ctx, txn);
 
 		if (data->include_lsn)
 		{
-			char *lsn_str = DatumGetCString(DirectFunctionCall1(pg_lsn_out, UInt64GetDatum(change->lsn)));
-			appendStringInfo(ctx->out, ",\"lsn\":\"%s\"", lsn_str);
-			pfree(lsn_str);
+			appendStringInfoString(ctx->out, ",\"lsn\":");
+			pg_append_lsn(data, ctx->out, change->lsn);
 		}
 
 		if (data->include_schemas)
 		{
 			appendStringInfo(ctx->out, ",\"schema\":");
-			escape_json(ctx->out, schemaname);
+			pg_escape_json(ctx->out, schemaname);
 		}
 
 		appendStringInfo(ctx->out, ",\"table\":");
-		escape_json(ctx->out, tablename);
+		pg_escape_json(ctx->out, tablename);
 
 		appendStringInfoChar(ctx->out, '}');
 		OutputPluginWrite(ctx, true);
@@ -3013,9 +6701,19 @@ parse_table_identifier(List *qualified_tables, char separator, List **select_tab
 		char		*str = lfirst(lc);
 		char		*startp;
 		char		*nextp;
+		char		*rawstr;
+		char		*rawp;
+		char		*pattern;
+		bool		haswildcard;
 		int			len;
 		SelectTable	*t = palloc0(sizeof(SelectTable));
 
+		/*
+		 * Keep escape characters for glob patterns. Unescaped '*' and '?' are
+		 * wildcards, except for the special "all schemas" and "all tables".
+		 */
+		rawstr = rawp = pstrdup(str);
+
 		/*
 		 * Detect a special character that means all schemas. There could be a
 		 * schema named "*" thus this test should be before we remove the
@@ -3039,6 +6737,7 @@ parse_table_identifier(List *qualified_tables, char separator, List **select_tab
 		/* if separator was not found, schema was not informed */
 		if (*nextp == '\0')
 		{
+			pfree(rawstr);
 			pfree(t);
 			return false;
 		}
@@ -3048,6 +6747,12 @@ parse_table_identifier(List *qualified_tables, char separator, List **select_tab
 			t->schemaname = (char *) palloc0((len + 1) * sizeof(char));
 			strncpy(t->schemaname, startp, len);
 
+			pattern = parse_table_pattern(&rawp, separator, &haswildcard);
+			if (haswildcard && !t->allschemas)
+				t->schemapattern = pattern;
+			else
+				pfree(pattern);
+
 			nextp++;			/* jump separator */
 			startp = nextp;		/* start new identifier (table name) */
 
@@ -3073,14 +6778,59 @@ parse_table_identifier(List *qualified_tables, char separator, List **select_tab
 			/* table name */
 			t->tablename = (char *) palloc0((len + 1) * sizeof(char));
 			strncpy(t->tablename, startp, len);
+
+			pattern = parse_table_pattern(&rawp, '\0', &haswildcard);
+			if (haswildcard && !t->alltables)
+				t->tablepattern = pattern;
+			else
+				pfree(pattern);
 		}
 
+		pfree(rawstr);
+
 		*select_tables = lappend(*select_tables, t);
 	}
 
 	return true;
 }
 
+/*
+ * Return a copy of the identifier that starts at *rawp and ends at the first
+ * unescaped separator. Escape characters are kept. *rawp is advanced past the
+ * separator. haswildcard is set if there is an unescaped '*' or '?'.
+ */
+static char *
+parse_table_pattern(char **rawp, char separator, bool *haswildcard)
+{
+	char	*startp;
+	char	*nextp;
+	char	*pattern;
+	int		len;
+
+	*haswildcard = false;
+
+	startp = nextp = *rawp;
+	while (*nextp && *nextp != separator)
+	{
+		if (*nextp == '*' || *nextp == '?')
+			*haswildcard = true;
+		else if (*nextp == '\\' && *(nextp + 1) != '\0')
+			nextp++;	/* ignore next character because of escape */
+		nextp++;
+	}
+	len = nextp - startp;
+
+	pattern = (char *) palloc0((len + 1) * sizeof(char));
+	strncpy(pattern, startp, len);
+
+	/* jump separator */
+	if (*nextp != '\0')
+		nextp++;
+	*rawp = nextp;
+
+	return pattern;
+}
+
 static bool
 string_to_SelectTable(char *rawstring, char separator, List **select_tables)
 {
@@ -3149,6 +6899,101 @@ string_to_SelectTable(char *rawstring, char separator, List **select_tables)
 	return true;
 }
 
+/*
+ * Convert a table-actions string into a list of SelectTable. Each element is a
+ * schema-qualified table followed by a colon and the actions for that table
+ * separated by a plus sign (e.g. public.foo:insert+update).
+ */
+static bool
+string_to_SelectTableAction(char *rawstring, char separator, List **select_tables)
+{
+	List		*elements = NIL;
+	ListCell	*lc;
+
+	if (!split_string_to_list(rawstring, separator, &elements))
+		return false;
+
+	foreach(lc, elements)
+	{
+		char		*str = lfirst(lc);
+		char		*nextp;
+		List		*qualified_tables = NIL;
+		List		*tables = NIL;
+		SelectTable	*t;
+
+		/* actions start after the first colon that is not escaped */
+		nextp = str;
+		while (*nextp && *nextp != ':')
+		{
+			if (*nextp == '\\' && *(nextp + 1) != '\0')
+				nextp++;	/* ignore next character because of escape */
+			nextp++;
+		}
+
+		/* actions were not informed */
+		if (*nextp == '\0')
+			return false;
+
+		/* Now safe to overwrite colon with a null */
+		*nextp++ = '\0';
+
+		qualified_tables = lappend(qualified_tables, str);
+		if (!parse_table_identifier(qualified_tables, '.', &tables))
+			return false;
+
+		t = (SelectTable *) linitial(tables);
+		if (!string_to_JsonAction(nextp, '+', &t->actions))
+			return false;
+
+		*select_tables = lappend(*select_tables, t);
+
+		list_free(qualified_tables);
+		list_free(tables);
+	}
+
+	list_free_deep(elements);
+
+	return true;
+}
+
+/*
+ * Convert a string into a set of actions
+ */
+static bool
+string_to_JsonAction(char *rawstring, char separator, JsonAction *actions)
+{
+	List		*selected_actions = NIL;
+	ListCell	*lc;
+
+	if (!split_string_to_list(rawstring, separator, &selected_actions))
+		return false;
+
+	actions->insert = false;
+	actions->update = false;
+	actions->delete = false;
+	actions->truncate = false;
+
+	foreach(lc, selected_actions)
+	{
+		char *p = lfirst(lc);
+
+		if (strcmp(p, "insert") == 0)
+			actions->insert = true;
+		else if (strcmp(p, "update") == 0)
+			actions->update = true;
+		else if (strcmp(p, "delete") == 0)
+			actions->delete = true;
+		else if (strcmp(p, "truncate") == 0)
+			actions->truncate = true;
+		else
+			return false;
+	}
+
+	list_free_deep(selected_actions);
+
+	return true;
+}
+
 static bool
 split_string_to_list(char *rawstring, char separator, List **sl)
 {
@@ -3274,6 +7119,108 @@ split_string_to_oid_list(char *rawstring, char separator, List **sl)
 	return true;
 }
 
+/*
+ * Convert a list of origin ids into a set. Origin ids are 16-bit integers
+ * hence the set is small and membership is tested in constant time.
+ */
+static Bitmapset *
+compile_origin_filter(List *origins)
+{
+	Bitmapset	*bs = NULL;
+	ListCell	*lc;
+
+	foreach(lc, origins)
+	{
+		Oid		originid = lfirst_oid(lc);
+
+		/* there is no such origin; it never matches */
+		if (originid > 0xFFFF)
+		{
+			elog(DEBUG1, "origin \"%u\" is out of range", originid);
+			continue;
+		}
+
+		bs = bms_add_member(bs, (int) originid);
+	}
+
+	return bs;
+}
+
+/*
+ * Compile a list of message prefixes. Return NULL if the list is empty.
+ */
+static JsonPrefixFilter *
+compile_prefix_filter(List *prefixes)
+{
+	JsonPrefixFilter	*pf;
+	ListCell			*lc;
+	int					n;
+
+	n = list_length(prefixes);
+	if (n == 0)
+		return NULL;
+
+	pf = (JsonPrefixFilter *) palloc0(sizeof(JsonPrefixFilter));
+	pf->exact = (char **) palloc(n * sizeof(char *));
+	pf->wildcard = (char **) palloc(n * sizeof(char *));
+	pf->wildcardlen = (int *) palloc(n * sizeof(int));
+
+	foreach(lc, prefixes)
+	{
+		char	*p = pstrdup(lfirst(lc));
+		int		len = strlen(p);
+
+		if (len > 0 && p[len - 1] == '*' && (len == 1 || p[len - 2] != '\\'))
+		{
+			/* wildcard; remove '*' */
+			p[len - 1] = '\0';
+			pf->wildcard[pf->nwildcard] = p;
+			pf->wildcardlen[pf->nwildcard] = len - 1;
+			pf->nwildcard++;
+		}
+		else
+		{
+			/* escaped '*' at the end is the character itself */
+			if (len > 1 && p[len - 1] == '*' && p[len - 2] == '\\')
+			{
+				p[len - 2] = '*';
+				p[len - 1] = '\0';
+			}
+			pf->exact[pf->nexact++] = p;
+		}
+	}
+
+	if (pf->nexact > 1)
+		qsort(pf->exact, pf->nexact, sizeof(char *), prefix_cmp);
+
+	return pf;
+}
+
+static int
+prefix_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/* Does this message prefix match the compiled prefixes? */
+static bool
+pg_match_prefix(JsonPrefixFilter *pf, const char *prefix)
+{
+	int		i;
+
+	if (pf->nexact > 0 &&
+		bsearch(&prefix, pf->exact, pf->nexact, sizeof(char *), prefix_cmp) != NULL)
+		return true;
+
+	for (i = 0; i < pf->nwildcard; i++)
+	{
+		if (strncmp(prefix, pf->wildcard[i], pf->wildcardlen[i]) == 0)
+			return true;
+	}
+
+	return false;
+}
+
 /*
  * Try to update progress and send a keepalive message if too many changes were
  * processed.